@@ -0,0 +1,240 @@
+#include <assert.h>
+#include <stddef.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+#include "opt.h"
+
+#define LEN(x) (sizeof(x) / sizeof(*x))
+
+// Every cached record takes a 4 KiB slot, so the cache passes run at most this many records, with twice as many slots
+#define CACHE_RECORDS 16384
+
+static double now(void) {
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static char *records_make(size_t records_len, size_t *records_size) {
+	const char *templates[] = {
+		"/usr/bin/prog\0-v\0--number\0%zu\0-o\0out.txt\0file1\0file2\0",
+		"/usr/bin/prog\0--must-write=true\0-o\0/tmp/%zu\0--must-write\0f\0",
+		"/usr/bin/prog\0-o\0log\0--\0-v\0--number\0%zu\0",
+		"/usr/bin/prog\0--number=%zu\0-v\0-v\0input\0",
+	};
+
+	size_t size = records_len * 80 + 1;
+	char *buf = malloc(size);
+	assert(buf != NULL);
+
+	size_t len = 0;
+	for (size_t record = 0; record < records_len; ++record) {
+		const char *template = templates[record % LEN(templates)];
+		size_t start = len;
+
+		// The templates hold NULs, so they are expanded one argument at a time
+		for (const char *arg = template; arg[0] != '\0'; arg += strlen(arg) + 1) {
+			len += snprintf(&buf[len], size - len, arg, record) + 1;
+		}
+		records_size[record] = len - start;
+	}
+
+	return buf;
+}
+
+// Every file is a record, like /proc/<pid>/cmdline, which can not be mapped
+static char *records_read(const char **paths, size_t paths_len, size_t *records_size) {
+	size_t size = 4096;
+	size_t len = 0;
+	char *buf = malloc(size);
+	assert(buf != NULL);
+
+	for (size_t record = 0; record < paths_len; ++record) {
+		int fd = open(paths[record], O_RDONLY);
+		if (fd < 0) {
+			perror(paths[record]);
+			exit(1);
+		}
+
+		size_t start = len;
+		for (;;) {
+			if (len == size) {
+				size *= 2;
+				buf = realloc(buf, size);
+				assert(buf != NULL);
+			}
+
+			ssize_t got = read(fd, &buf[len], size - len);
+			if (got < 0) {
+				perror(paths[record]);
+				exit(1);
+			}
+
+			if (got == 0) break;
+			len += got;
+		}
+		close(fd);
+
+		records_size[record] = len - start;
+	}
+
+	return buf;
+}
+
+int main(int argc, const char **argv) {
+	Opt_Result result;
+	Opt_Match matches[10];
+	opt_result_init(&result, matches, LEN(matches));
+
+	Opt_Info bench_opts[4];
+	opt_info_init(&bench_opts[0], "threads", "t", "Set maximum worker threads", OPT_VALUE_INT, NULL, OPT_INFO_MATCH_LAST);
+	opt_info_init(&bench_opts[1], "records", "n", "Set generated records", OPT_VALUE_INT, NULL, OPT_INFO_MATCH_LAST);
+	opt_info_init(&bench_opts[2], "repeat", "r", "Set runs per thread count", OPT_VALUE_INT, NULL, OPT_INFO_MATCH_LAST);
+	opt_info_init(&bench_opts[3], "cache", "c", "Also run records through a parse cache", OPT_VALUE_STRING, "FILE", OPT_INFO_MATCH_LAST);
+
+	Opt_Parser bench_parser;
+	opt_parser_init(&bench_parser, bench_opts, LEN(bench_opts));
+
+	Opt_Error error = opt_parser_run(&bench_parser, &result, argv, argc);
+	if (error.kind != OPT_ERROR_NONE) {
+		const char *args[] = { "[FILE...]" };
+		Opt_Usage usage = {
+			.name = argv[0],
+			.args = args,
+			.args_len = LEN(args),
+			.line_max = 90,
+		};
+		opt_info_help(bench_opts, LEN(bench_opts), NULL, NULL, &usage, stderr);
+		exit(1);
+	}
+
+	long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+	size_t threads_max = cpus > 0 ? cpus : 1;
+	size_t records_len = 1000000;
+	size_t repeat = 3;
+	const char *cache_path = NULL;
+
+	const char **paths = malloc(argc * sizeof(const char *));
+	size_t paths_len = 0;
+	assert(paths != NULL);
+
+	for (size_t i = 0; i < result.matches_len; ++i) {
+		Opt_Match match = result.matches[i];
+		if (match.kind == OPT_MATCH_SIMPLE) paths[paths_len++] = match.simple;
+		else if (match.option.opt == 0) threads_max = match.option.value.vint;
+		else if (match.option.opt == 1) records_len = match.option.value.vint;
+		else if (match.option.opt == 2) repeat = match.option.value.vint;
+		else if (match.option.opt == 3) cache_path = match.option.value.vstring;
+	}
+
+	if (paths_len != 0) records_len = paths_len;
+	size_t *records_size = malloc(records_len * sizeof(size_t) + 1);
+	assert(records_size != NULL);
+
+	char *buf = paths_len != 0 ? records_read(paths, paths_len, records_size) : records_make(records_len, records_size);
+	size_t buf_len = 0;
+	for (size_t record = 0; record < records_len; ++record) buf_len += records_size[record];
+
+	Opt_Info opts[5];
+	opt_info_init(&opts[0], "help", "h", "Show help information", OPT_VALUE_NONE, NULL, OPT_INFO_STOP_PARSER);
+	opt_info_init(&opts[1], "verbose", "v", "Set verbose output", OPT_VALUE_NONE, NULL, OPT_INFO_MATCH_FIRST);
+	opt_info_init(&opts[2], "", "o", "Set output file path", OPT_VALUE_STRING, "FILE", OPT_INFO_MATCH_MISSING);
+	opt_info_init(&opts[3], "must-write", NULL, "Set must-write flag", OPT_VALUE_BOOL, NULL, OPT_INFO_MATCH_LAST);
+	opt_info_init(&opts[4], "number", NULL, "Set number", OPT_VALUE_INT, NULL, OPT_INFO_STOP_DUPLICATE);
+
+	Opt_Parser parser;
+	opt_parser_init(&parser, opts, LEN(opts));
+
+	Opt_Batch batch;
+	double start = now();
+	if (!opt_batch_init(&batch, buf, records_size, records_len)) {
+		fprintf(stderr, "error: malformed records buffer\n");
+		exit(1);
+	}
+	double split = now() - start;
+
+	printf("records: %zu, arguments: %zu, bytes: %zu, split: %.3f ms\n", batch.records_len, batch.args_len, buf_len, split * 1e3);
+
+	if (threads_max == 0) threads_max = 1;
+	if (repeat == 0) repeat = 1;
+
+	for (size_t threads = 1;; threads = threads * 2 < threads_max ? threads * 2 : threads_max) {
+		double best = 0;
+		for (size_t run = 0; run < repeat; ++run) {
+			start = now();
+			if (!opt_batch_run(&batch, &parser, threads)) {
+				fprintf(stderr, "error: out of memory\n");
+				exit(1);
+			}
+
+			double elapsed = now() - start;
+			if (run == 0 || elapsed < best) best = elapsed;
+		}
+
+		size_t failed = 0;
+		for (size_t record = 0; record < batch.records_len; ++record) {
+			Opt_Error_Kind kind = batch.errors[record].kind;
+			failed += kind != OPT_ERROR_NONE && kind != OPT_ERROR_STOPPED;
+		}
+
+		double rate = batch.records_len / best;
+		printf("threads: %zu, time: %.3f ms, records/sec: %.0f, records/sec/core: %.0f, failed: %zu\n", threads, best * 1e3, rate, rate / threads, failed);
+		if (threads == threads_max) break;
+	}
+
+	if (cache_path != NULL) {
+		Opt_Cache cache;
+		size_t cache_records = batch.records_len < CACHE_RECORDS ? batch.records_len : CACHE_RECORDS;
+		if (!opt_cache_open(&cache, cache_path, 2 * cache_records + 1)) {
+			perror(cache_path);
+			exit(1);
+		}
+
+		printf("cache records: %zu, slots: %zu\n", cache_records, cache.slots_len);
+
+		size_t argc_max = 0;
+		for (size_t record = 0; record < cache_records; ++record) {
+			if (batch.records_argc[record] > argc_max) argc_max = batch.records_argc[record];
+		}
+
+		Opt_Match *cache_matches = malloc((argc_max + LEN(opts)) * sizeof(Opt_Match));
+		assert(cache_matches != NULL);
+
+		const char *passes[] = { "parse", "cache cold", "cache warm" };
+		for (size_t pass = 0; pass < LEN(passes); ++pass) {
+			Opt_Cache_Stats before = cache.stats;
+			start = now();
+
+			for (size_t record = 0; record < cache_records; ++record) {
+				if (batch.records_argc[record] == 0) continue;
+
+				Opt_Result cache_result;
+				opt_result_init(&cache_result, cache_matches, batch.records_argc[record] + LEN(opts));
+
+				const char **args = &batch.args[batch.records_arg[record]];
+				if (pass == 0) opt_parser_run(&parser, &cache_result, args, batch.records_argc[record]);
+				else opt_cache_run(&cache, &parser, &cache_result, args, batch.records_argc[record]);
+			}
+
+			double elapsed = now() - start;
+			printf("%s: time: %.3f ms, records/sec: %.0f, hits: %lu, misses: %lu, stores: %lu, oversized: %lu\n", passes[pass], elapsed * 1e3,
+					cache_records / elapsed, cache.stats.hits - before.hits, cache.stats.misses - before.misses, cache.stats.stores - before.stores,
+					cache.stats.oversized - before.oversized);
+		}
+
+		free(cache_matches);
+		opt_cache_close(&cache);
+	}
+
+	opt_batch_free(&batch);
+	free(records_size);
+	free(paths);
+	free(buf);
+
+	return 0;
+}
@@ -0,0 +1,607 @@
+#include <assert.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+
+// Built with the library sources, so cache entries can be damaged in place
+#include "opt.c"
+
+#define LEN(x) (sizeof(x) / sizeof(*x))
+
+#define CHECK(cond) check((cond), #cond, __FILE__, __LINE__)
+
+static size_t failed = 0;
+
+static void check(bool ok, const char *cond, const char *file, int line) {
+	if (ok) return;
+	fprintf(stderr, "%s:%d: check failed: %s\n", file, line, cond);
+	++failed;
+}
+
+// Runs argv, which ends with NULL, through the parser
+static Opt_Error run(Opt_Parser *parser, Opt_Result *result, Opt_Match *matches, size_t matches_len, const char **argv) {
+	int argc = 0;
+	while (argv[argc] != NULL) ++argc;
+
+	opt_result_init(result, matches, matches_len);
+	return opt_parser_run(parser, result, argv, argc);
+}
+
+static void check_lists(void) {
+	Opt_Info opts[4];
+	opt_info_init(&opts[0], "ids", NULL, "", OPT_VALUE_INT_LIST, NULL, OPT_INFO_MATCH_LAST);
+	opt_info_init(&opts[1], "first", NULL, "", OPT_VALUE_INT_LIST, NULL, OPT_INFO_MATCH_FIRST);
+	opt_info_init(&opts[2], "names", NULL, "", OPT_VALUE_STRING_LIST, NULL, OPT_INFO_NONE);
+	opt_info_init(&opts[3], "scales", NULL, "", OPT_VALUE_FLOAT_LIST, NULL, OPT_INFO_NONE);
+
+	int64_t items[64];
+	Opt_Arena arena;
+	opt_arena_init(&arena, items, sizeof(items));
+
+	Opt_Parser parser;
+	opt_parser_init(&parser, opts, LEN(opts));
+	parser.arena = &arena;
+
+	Opt_Result result;
+	Opt_Match matches[8];
+	Opt_Error error;
+	Opt_Value value;
+
+	arena.len = 0;
+	error = run(&parser, &result, matches, LEN(matches), (const char *[]) { "prog", "--ids", "-9223372036854775808,9223372036854775807", NULL });
+	value = result.matches[0].option.value;
+	CHECK(error.kind == OPT_ERROR_NONE);
+	CHECK(value.vlist.len == 2 && value.vlist.ints[0] == INT64_MIN && value.vlist.ints[1] == INT64_MAX);
+
+	arena.len = 0;
+	error = run(&parser, &result, matches, LEN(matches), (const char *[]) { "prog", "--ids", "1,9223372036854775808", NULL });
+	CHECK(error.kind == OPT_ERROR_INVALID_VALUE && error.invalid.offset == 2);
+
+	arena.len = 0;
+	error = run(&parser, &result, matches, LEN(matches), (const char *[]) { "prog", "--ids", "-9223372036854775809", NULL });
+	CHECK(error.kind == OPT_ERROR_INVALID_VALUE && error.invalid.offset == 0);
+
+	arena.len = 0;
+	error = run(&parser, &result, matches, LEN(matches), (const char *[]) { "prog", "--ids", "0x10,010,-0x1,0,7-9", NULL });
+	value = result.matches[0].option.value;
+	CHECK(error.kind == OPT_ERROR_NONE);
+	CHECK(value.vlist.len == 7 && value.vlist.ints[0] == 16 && value.vlist.ints[1] == 8 && value.vlist.ints[2] == -1);
+	CHECK(value.vlist.ints[3] == 0 && value.vlist.ints[4] == 7 && value.vlist.ints[6] == 9);
+
+	// Only string lists can have empty elements
+	arena.len = 0;
+	error = run(&parser, &result, matches, LEN(matches), (const char *[]) { "prog", "--ids", "1,2,", NULL });
+	CHECK(error.kind == OPT_ERROR_INVALID_VALUE && error.invalid.offset == 4);
+
+	arena.len = 0;
+	error = run(&parser, &result, matches, LEN(matches), (const char *[]) { "prog", "--scales", "1.5,-2e3,", NULL });
+	CHECK(error.kind == OPT_ERROR_INVALID_VALUE && error.invalid.offset == 9);
+
+	arena.len = 0;
+	error = run(&parser, &result, matches, LEN(matches), (const char *[]) { "prog", "--names", "a,,b,", NULL });
+	value = result.matches[0].option.value;
+	CHECK(error.kind == OPT_ERROR_NONE && value.vlist.len == 4);
+	CHECK(value.vlist.strings[1].len == 0 && value.vlist.strings[2].len == 1 && value.vlist.strings[3].len == 0);
+
+	arena.len = 0;
+	error = run(&parser, &result, matches, LEN(matches), (const char *[]) { "prog", "--ids", "1-65", NULL });
+	CHECK(error.kind == OPT_ERROR_LIST_OVERFLOW && error.invalid.offset == 0);
+
+	arena.len = 0;
+	error = run(&parser, &result, matches, LEN(matches), (const char *[]) { "prog", "--ids", "1-63,64,65", NULL });
+	CHECK(error.kind == OPT_ERROR_LIST_OVERFLOW && error.invalid.offset == 8);
+
+	// Replaced and ignored lists do not keep their arena space
+	arena.len = 0;
+	error = run(&parser, &result, matches, LEN(matches), (const char *[]) { "prog", "--ids", "1-40", "--ids", "1-40", NULL });
+	value = result.matches[0].option.value;
+	CHECK(error.kind == OPT_ERROR_NONE && result.matches_len == 1 && value.vlist.len == 40);
+
+	arena.len = 0;
+	error = run(&parser, &result, matches, LEN(matches), (const char *[]) { "prog", "--ids", "1-40", "--names", "a", "--ids", "2-30", NULL });
+	value = result.matches[0].option.value;
+	CHECK(error.kind == OPT_ERROR_NONE && value.vlist.len == 29 && value.vlist.ints[0] == 2);
+	CHECK(result.matches[1].option.value.vlist.len == 1);
+
+	arena.len = 0;
+	error = run(&parser, &result, matches, LEN(matches), (const char *[]) { "prog", "--first", "1-40", "--first", "1-60", NULL });
+	value = result.matches[0].option.value;
+	CHECK(error.kind == OPT_ERROR_NONE && result.matches_len == 1 && value.vlist.len == 40 && arena.len == 40 * sizeof(int64_t));
+
+	arena.len = 0;
+	error = run(&parser, &result, matches, LEN(matches), (const char *[]) { "prog", "--first", "1", "--first", "1,x", NULL });
+	CHECK(error.kind == OPT_ERROR_INVALID_VALUE && error.invalid.offset == 2);
+
+	// Batch workers bring their own arenas
+	char buf[128];
+	size_t records_size[3];
+	size_t len = 0;
+	for (size_t record = 0; record < LEN(records_size); ++record) {
+		const char *args[] = { "prog", "--ids", record == 2 ? "1-100000" : "1,2", "--names", "a,b" };
+		size_t start = len;
+		for (size_t arg = 0; arg < LEN(args); ++arg) len += sprintf(&buf[len], "%s", args[arg]) + 1;
+		records_size[record] = len - start;
+	}
+
+	Opt_Batch batch;
+	CHECK(opt_batch_init(&batch, buf, records_size, LEN(records_size)));
+	CHECK(opt_batch_run(&batch, &parser, 2));
+	for (size_t record = 0; record < batch.records_len; ++record) {
+		opt_batch_result(&batch, record, &result);
+		CHECK(batch.errors[record].kind == OPT_ERROR_NONE && result.matches_len == 2);
+		CHECK(result.matches[0].option.value.vlist.len == (record == 2 ? 100000 : 2));
+		CHECK(result.matches[1].option.value.vlist.len == 2 && result.matches[1].option.value.vlist.strings[1].ptr[0] == 'b');
+	}
+	opt_batch_free(&batch);
+
+	// Empty arguments and empty records are kept, records must end with a NUL
+	static const char edges[] = "prog\0\0x\0prog\0--ids";
+	const size_t edges_size[] = { 8, 0, 5, 5 };
+	CHECK(opt_batch_init(&batch, edges, edges_size, 3));
+	CHECK(opt_batch_run(&batch, &parser, 2));
+	CHECK(batch.records_argc[0] == 3 && batch.records_argc[1] == 0 && batch.records_argc[2] == 1);
+
+	opt_batch_result(&batch, 0, &result);
+	CHECK(batch.errors[0].kind == OPT_ERROR_NONE && result.matches_len == 2);
+	CHECK(result.matches[0].kind == OPT_MATCH_SIMPLE && result.matches[0].simple[0] == '\0');
+	CHECK(result.matches[1].kind == OPT_MATCH_SIMPLE && strcmp(result.matches[1].simple, "x") == 0);
+
+	opt_batch_result(&batch, 1, &result);
+	CHECK(batch.errors[1].kind == OPT_ERROR_NONE && result.bin_name == NULL && result.matches_len == 0);
+
+	opt_batch_result(&batch, 2, &result);
+	CHECK(batch.errors[2].kind == OPT_ERROR_NONE && strcmp(result.bin_name, "prog") == 0 && result.matches_len == 0);
+	opt_batch_free(&batch);
+
+	CHECK(!opt_batch_init(&batch, edges, edges_size, LEN(edges_size)));
+	CHECK(batch.records_len == 0 && batch.args == NULL);
+}
+
+static void check_lazy(void) {
+	Opt_Info opts[3];
+	opt_info_init(&opts[0], "number", "n", "", OPT_VALUE_INT, NULL, OPT_INFO_MATCH_LAST);
+	opt_info_init(&opts[1], "scale", "s", "", OPT_VALUE_FLOAT, NULL, OPT_INFO_MATCH_FIRST);
+	opt_info_init(&opts[2], "write", "w", "", OPT_VALUE_BOOL, NULL, OPT_INFO_MATCH_LAST);
+
+	Opt_Parser parser;
+	opt_parser_init(&parser, opts, LEN(opts));
+
+	Opt_Result result;
+	Opt_Match matches[8];
+	Opt_Error error;
+	int64_t vint = 0;
+	double vfloat = 0;
+	bool vbool = false;
+
+	// Eager parsers fail on the first invalid token, even if a later one replaces it
+	error = run(&parser, &result, matches, LEN(matches), (const char *[]) { "prog", "-n", "x", "-n", "5", NULL });
+	CHECK(error.kind == OPT_ERROR_INVALID_VALUE);
+
+	// Lazy parsers only convert what is kept
+	parser.lazy = true;
+	error = run(&parser, &result, matches, LEN(matches), (const char *[]) { "prog", "-n", "x", "-n", "5", "-s", "1.5", "-s", "y", NULL });
+	CHECK(error.kind == OPT_ERROR_NONE && result.matches_len == 2);
+	CHECK(result.matches[0].option.value.lazy && result.matches[1].option.value.lazy);
+	CHECK(opt_result_validate(&result).kind == OPT_ERROR_NONE);
+	CHECK(opt_value_int(&result.matches[0].option.value, &vint).kind == OPT_ERROR_NONE && vint == 5);
+	CHECK(opt_value_float(&result.matches[1].option.value, &vfloat).kind == OPT_ERROR_NONE && vfloat == 1.5);
+	CHECK(!result.matches[0].option.value.lazy);
+
+	// A kept invalid token fails on every access, and keeps the raw token
+	error = run(&parser, &result, matches, LEN(matches), (const char *[]) { "prog", "-n", "5", "-n", "0x", "-w", "maybe", NULL });
+	CHECK(error.kind == OPT_ERROR_NONE && result.matches_len == 2);
+	for (size_t access = 0; access < 2; ++access) {
+		error = opt_value_int(&result.matches[0].option.value, &vint);
+		CHECK(error.kind == OPT_ERROR_INVALID_VALUE && error.invalid.expected_value == OPT_VALUE_INT);
+		CHECK(result.matches[0].option.value.lazy && strcmp(result.matches[0].option.value.vstring, "0x") == 0);
+	}
+
+	error = opt_result_validate(&result);
+	CHECK(error.kind == OPT_ERROR_INVALID_VALUE && strcmp(error.invalid.base, "0x") == 0);
+	CHECK(opt_value_bool(&result.matches[1].option.value, &vbool).kind == OPT_ERROR_INVALID_VALUE);
+
+	error = run(&parser, &result, matches, LEN(matches), (const char *[]) { "prog", "-w", "true", NULL });
+	CHECK(opt_result_validate(&result).kind == OPT_ERROR_NONE && opt_value_bool(&result.matches[0].option.value, &vbool).kind == OPT_ERROR_NONE && vbool);
+}
+
+static void check_cache(void) {
+	Opt_Info opts[2];
+	opt_info_init(&opts[0], "verbose", "v", "", OPT_VALUE_NONE, NULL, OPT_INFO_MATCH_FIRST);
+	opt_info_init(&opts[1], "number", "n", "", OPT_VALUE_INT, NULL, OPT_INFO_MATCH_LAST);
+
+	Opt_Parser parser;
+	opt_parser_init(&parser, opts, LEN(opts));
+
+	char path[] = "/tmp/opt-check-XXXXXX";
+	int fd = mkstemp(path);
+	CHECK(fd >= 0);
+	close(fd);
+
+	// An existing file keeps its size, whatever the later opens ask for
+	Opt_Cache cache;
+	Opt_Cache other;
+	CHECK(opt_cache_open(&cache, path, 64));
+	CHECK(opt_cache_open(&other, path, 128));
+	CHECK(cache.slots_len == 64 && other.slots_len == 64);
+
+	Opt_Result result;
+	Opt_Match matches[8];
+	const char *argv[] = { "prog", "-v", "-n", "12", "file" };
+
+	for (size_t pass = 0; pass < 2; ++pass) {
+		opt_result_init(&result, matches, LEN(matches));
+		CHECK(opt_cache_run(pass == 0 ? &cache : &other, &parser, &result, argv, LEN(argv)).kind == OPT_ERROR_NONE);
+		CHECK(result.matches_len == 3 && result.matches[1].option.value.vint == 12 && result.matches[2].simple == argv[4]);
+	}
+
+	Opt_Cache_Stats stats;
+	opt_cache_stats(&cache, &stats);
+	CHECK(stats.misses == 1 && stats.stores == 1 && stats.hits == 1 && other.stats.hits == 1);
+
+	// Results that do not fit a slot are parsed every time and counted apart
+	const char *many[140];
+	Opt_Match many_matches[LEN(many)];
+	many[0] = "prog";
+	for (size_t arg = 1; arg < LEN(many); ++arg) many[arg] = "file";
+
+	for (size_t pass = 0; pass < 2; ++pass) {
+		opt_result_init(&result, many_matches, LEN(many_matches));
+		CHECK(opt_cache_run(&cache, &parser, &result, many, LEN(many)).kind == OPT_ERROR_NONE && result.matches_len == LEN(many) - 1);
+	}
+
+	opt_cache_stats(&cache, &stats);
+	CHECK(stats.misses == 3 && stats.stores == 1 && stats.oversized == 2 && cache.stats.oversized == 2);
+
+	opt_cache_close(&other);
+	opt_cache_close(&cache);
+	unlink(path);
+}
+
+// Damages one field of the entry stored for argv and signs it again, the next run must miss
+static void cache_damage(Opt_Cache *cache, Opt_Parser *parser, const char **argv, int argc, size_t match, size_t field, uint32_t value) {
+	Opt_Table view;
+	size_t epoch = 0;
+	Opt_Table *table = parser_enter(parser, &view, &epoch);
+	uint64_t key = cache_key(parser, table, argv, argc);
+	parser_leave(parser, epoch);
+
+	for (size_t way = 0; way < CACHE_WAYS; ++way) {
+		Cache_Slot *slot = cache_slot(cache, key, way);
+		if (slot->key != key) continue;
+
+		Cache_Match cached;
+		uint8_t *data = &slot->data[sizeof(Cache_Entry) + match * sizeof(Cache_Match)];
+		memcpy(&cached, data, sizeof(cached));
+
+		if (field == 0) cached.kind = value;
+		else if (field == 1) cached.value_kind = value;
+		else if (field == 2) cached.index = value;
+		else if (field == 3) cached.offset = value;
+		else {
+			// String list refs follow the matches, the field picks the item
+			Cache_Ref ref;
+			memcpy(&ref, &slot->data[cached.raw + (field - 4) * sizeof(ref)], sizeof(ref));
+			ref.len = value;
+			memcpy(&slot->data[cached.raw + (field - 4) * sizeof(ref)], &ref, sizeof(ref));
+		}
+
+		memcpy(data, &cached, sizeof(cached));
+		slot->check = cache_check(key, slot->data, slot->len);
+		return;
+	}
+
+	CHECK(!"entry not stored");
+}
+
+static void check_cache_damage(void) {
+	Opt_Info opts[2];
+	opt_info_init(&opts[0], "number", "n", "", OPT_VALUE_INT, NULL, OPT_INFO_MATCH_LAST);
+	opt_info_init(&opts[1], "names", NULL, "", OPT_VALUE_STRING_LIST, NULL, OPT_INFO_NONE);
+
+	int64_t items[16];
+	Opt_Arena arena;
+	opt_arena_init(&arena, items, sizeof(items));
+
+	Opt_Parser parser;
+	opt_parser_init(&parser, opts, LEN(opts));
+	parser.arena = &arena;
+
+	char path[] = "/tmp/opt-check-XXXXXX";
+	int fd = mkstemp(path);
+	CHECK(fd >= 0);
+	close(fd);
+
+	Opt_Cache cache;
+	CHECK(opt_cache_open(&cache, path, 16));
+
+	Opt_Result result;
+	Opt_Match matches[8];
+	const char *argv[] = { "prog", "-n", "12", "--names", "a,bc", "file" };
+
+	// Unknown kinds, ids past the table, and offsets or lengths past their argument
+	const size_t damages[][3] = {
+		{ 0, 0, 7 },
+		{ 0, 1, OPT_VALUE_STRING_LIST + 1 },
+		{ 0, 2, LEN(opts) },
+		{ 2, 3, 5 },
+		{ 1, 5, 3 },
+	};
+
+	for (size_t damage = 0; damage <= LEN(damages); ++damage) {
+		if (damage != 0) cache_damage(&cache, &parser, argv, LEN(argv), damages[damage - 1][0], damages[damage - 1][1], damages[damage - 1][2]);
+
+		arena.len = 0;
+		opt_result_init(&result, matches, LEN(matches));
+		CHECK(opt_cache_run(&cache, &parser, &result, argv, LEN(argv)).kind == OPT_ERROR_NONE && result.matches_len == 3);
+		CHECK(result.matches[0].option.value.vint == 12 && result.matches[2].simple == argv[5]);
+
+		Opt_Value value = result.matches[1].option.value;
+		CHECK(value.vlist.len == 2 && value.vlist.strings[1].ptr == &argv[4][2] && value.vlist.strings[1].len == 2);
+	}
+
+	CHECK(cache.stats.hits == 0 && cache.stats.misses == LEN(damages) + 1 && arena.len == 2 * sizeof(Opt_Slice));
+
+	// An undamaged entry still hits
+	arena.len = 0;
+	opt_result_init(&result, matches, LEN(matches));
+	opt_cache_run(&cache, &parser, &result, argv, LEN(argv));
+	CHECK(cache.stats.hits == 1 && result.matches_len == 3);
+
+	opt_cache_close(&cache);
+	unlink(path);
+}
+
+static bool same_run(Opt_Parser *first, Opt_Parser *second, const char **argv) {
+	Opt_Result results[2];
+	Opt_Match matches[2][8];
+	Opt_Error errors[2] = {
+		run(first, &results[0], matches[0], LEN(matches[0]), argv),
+		run(second, &results[1], matches[1], LEN(matches[1]), argv),
+	};
+
+	if (errors[0].kind != errors[1].kind || results[0].matches_len != results[1].matches_len) return false;
+	for (size_t i = 0; i < results[0].matches_len; ++i) {
+		Opt_Match *match = &results[0].matches[i];
+		Opt_Match *other = &results[1].matches[i];
+		if (match->kind != other->kind) return false;
+		if (match->kind == OPT_MATCH_OPTION && (match->option.opt != other->option.opt || match->option.value.vint != other->option.value.vint)) return false;
+	}
+
+	return true;
+}
+
+static void check_registry(void) {
+	Opt_Info opts[3];
+	opt_info_init(&opts[0], "number", "n", "", OPT_VALUE_INT, NULL, OPT_INFO_MATCH_LAST);
+	opt_info_init(&opts[1], "verbose", "v", "", OPT_VALUE_NONE, NULL, OPT_INFO_MATCH_FIRST);
+	opt_info_init(&opts[2], "num", NULL, "", OPT_VALUE_INT, NULL, OPT_INFO_MATCH_LAST);
+
+	Opt_Parser fixed;
+	opt_parser_init(&fixed, opts, LEN(opts));
+
+	Opt_Parser parser;
+	opt_parser_init(&parser, opts, LEN(opts));
+
+	Opt_Info extra;
+	opt_info_init(&extra, "extra", "e", "", OPT_VALUE_NONE, NULL, OPT_INFO_NONE);
+	CHECK(opt_parser_add(&parser, &extra) == 3);
+	CHECK(opt_parser_add(&parser, &extra) == OPT_ID_NONE);
+	CHECK(opt_parser_remove(&parser, 3));
+	CHECK(!opt_parser_remove(&parser, 3));
+
+	// Options are matched by the first name starting the argument, with or without added options
+	const char *argvs[][5] = {
+		{ "prog", "--numberx", "3", NULL },
+		{ "prog", "--num=4", NULL },
+		{ "prog", "--numb", "2", NULL },
+		{ "prog", "-n7", "5", NULL },
+		{ "prog", "-vx", NULL },
+		{ "prog", "--verbose", "-n", "1", NULL },
+		{ "prog", "--nu", NULL },
+	};
+
+	for (size_t i = 0; i < LEN(argvs); ++i) CHECK(same_run(&fixed, &parser, argvs[i]));
+
+	// Ids are never given twice
+	CHECK(opt_parser_add(&parser, &extra) == 4);
+	CHECK(opt_parser_remove(&parser, 1));
+	CHECK(!opt_parser_remove(&parser, 3));
+
+	Opt_Info verbose = opts[1];
+	CHECK(opt_parser_add(&parser, &verbose) == 5);
+
+	Opt_Info listed[2];
+	size_t ids[2];
+	CHECK(opt_parser_list(&parser, listed, ids, LEN(listed)) == 4);
+	CHECK(ids[0] == 0 && ids[1] == 2 && strcmp(listed[1].long_name, "num") == 0);
+
+	Opt_Result result;
+	Opt_Match matches[8];
+	Opt_Error error = run(&parser, &result, matches, LEN(matches), (const char *[]) { "prog", "-e", "--verbose", "--num", "8", NULL });
+	CHECK(error.kind == OPT_ERROR_NONE && result.matches_len == 3);
+	CHECK(result.matches[0].option.opt == 4 && result.matches[1].option.opt == 5 && result.matches[2].option.opt == 2);
+
+	// Names of removed options can be freed once reclaimed, and later changes do not read them
+	char *plugin_name = strdup("plugin");
+	Opt_Info plugin;
+	opt_info_init(&plugin, plugin_name, NULL, "", OPT_VALUE_NONE, NULL, OPT_INFO_NONE);
+	size_t plugin_id = opt_parser_add(&parser, &plugin);
+	CHECK(plugin_id == 6 && opt_parser_remove(&parser, plugin_id));
+	CHECK(opt_parser_reclaim(&parser));
+	free(plugin_name);
+
+	Opt_Info later;
+	opt_info_init(&later, "later", NULL, "", OPT_VALUE_NONE, NULL, OPT_INFO_NONE);
+	CHECK(opt_parser_add(&parser, &later) == 7);
+	error = run(&parser, &result, matches, LEN(matches), (const char *[]) { "prog", "--later", NULL });
+	CHECK(error.kind == OPT_ERROR_NONE && result.matches[0].option.opt == 7);
+
+	CHECK(opt_parser_reclaim(&parser));
+	opt_parser_free(&parser);
+}
+
+typedef struct {
+	Opt_Parser *parser;
+	atomic_bool *stop;
+	size_t runs;
+	size_t bad;
+} Registry_Reader;
+
+// Every run sees either the table with --extra or the one without it, never a mix
+static void *registry_read(void *arg) {
+	Registry_Reader *reader = arg;
+	const char *argv[] = { "prog", "--base", "--extra=3", "file" };
+
+	while (!atomic_load(reader->stop) || reader->runs == 0) {
+		Opt_Result result;
+		Opt_Match matches[8];
+		opt_result_init(&result, matches, LEN(matches));
+		Opt_Error error = opt_parser_run(reader->parser, &result, argv, LEN(argv));
+
+		if (error.kind == OPT_ERROR_NONE) {
+			bool ok = result.matches_len == 3 && result.matches[0].option.opt == 0 && result.matches[1].option.opt != OPT_ID_NONE;
+			reader->bad += !ok || result.matches[1].option.value.vint != 3;
+		} else reader->bad += error.kind != OPT_ERROR_UNKNOWN_OPTION || strcmp(error.unknown_opt, "--extra=3") != 0;
+
+		++reader->runs;
+	}
+
+	return NULL;
+}
+
+static void check_registry_threads(void) {
+	Opt_Info opts[1];
+	opt_info_init(&opts[0], "base", "b", "", OPT_VALUE_NONE, NULL, OPT_INFO_NONE);
+
+	Opt_Parser parser;
+	opt_parser_init(&parser, opts, LEN(opts));
+
+	atomic_bool stop;
+	atomic_init(&stop, false);
+
+	pthread_t threads[3];
+	Registry_Reader readers[LEN(threads)];
+	for (size_t thread = 0; thread < LEN(threads); ++thread) {
+		readers[thread] = (Registry_Reader) {
+			.parser = &parser,
+			.stop = &stop,
+		};
+		CHECK(pthread_create(&threads[thread], NULL, registry_read, &readers[thread]) == 0);
+	}
+
+	// Filler options make tables grow, get compacted and be indexed again while runs go on
+	Opt_Info extra;
+	opt_info_init(&extra, "extra", "e", "", OPT_VALUE_INT, NULL, OPT_INFO_NONE);
+	size_t fillers[32];
+	char names[LEN(fillers)][16];
+
+	for (size_t round = 0; round < 200; ++round) {
+		size_t id = opt_parser_add(&parser, &extra);
+		CHECK(id != OPT_ID_NONE);
+
+		for (size_t filler = 0; filler < LEN(fillers); ++filler) {
+			snprintf(names[filler], sizeof(names[filler]), "filler-%zu", filler);
+			Opt_Info info;
+			opt_info_init(&info, names[filler], NULL, "", OPT_VALUE_NONE, NULL, OPT_INFO_NONE);
+			fillers[filler] = opt_parser_add(&parser, &info);
+		}
+
+		for (size_t filler = 0; filler < LEN(fillers); ++filler) CHECK(opt_parser_remove(&parser, fillers[filler]));
+		CHECK(opt_parser_remove(&parser, id));
+		opt_parser_reclaim(&parser);
+	}
+
+	atomic_store(&stop, true);
+	for (size_t thread = 0; thread < LEN(threads); ++thread) {
+		pthread_join(threads[thread], NULL);
+		CHECK(readers[thread].runs != 0 && readers[thread].bad == 0);
+	}
+
+	CHECK(opt_parser_reclaim(&parser));
+	opt_parser_free(&parser);
+}
+
+static void check_pack(void) {
+	Opt_Info opts[6];
+	opt_info_init(&opts[0], "name", NULL, "", OPT_VALUE_STRING, NULL, OPT_INFO_NONE);
+	opt_info_init(&opts[1], "number", NULL, "", OPT_VALUE_INT, NULL, OPT_INFO_NONE);
+	opt_info_init(&opts[2], "scale", NULL, "", OPT_VALUE_FLOAT, NULL, OPT_INFO_NONE);
+	opt_info_init(&opts[3], "ids", NULL, "", OPT_VALUE_INT_LIST, NULL, OPT_INFO_NONE);
+	opt_info_init(&opts[4], "tags", NULL, "", OPT_VALUE_STRING_LIST, NULL, OPT_INFO_NONE);
+	opt_info_init(&opts[5], "output", "o", "", OPT_VALUE_STRING, NULL, OPT_INFO_MATCH_MISSING);
+
+	int64_t items[16];
+	Opt_Arena arena;
+	opt_arena_init(&arena, items, sizeof(items));
+
+	Opt_Parser parser;
+	opt_parser_init(&parser, opts, LEN(opts));
+	parser.arena = &arena;
+
+	Opt_Result result;
+	Opt_Match matches[10];
+	Opt_Error error = run(&parser, &result, matches, LEN(matches), (const char *[]) { "prog", "--name", "x", "--number", "-7", "--scale", "0.5", "--ids", "1-3", "--tags", "a,bc", "file", NULL });
+	CHECK(error.kind == OPT_ERROR_NONE && result.matches_len == 7);
+
+	size_t size = opt_result_pack(&result, NULL, 0);
+	uint64_t packed[64];
+	uint64_t moved[64];
+	CHECK(size != 0 && size <= sizeof(packed));
+	CHECK(opt_result_pack(&result, packed, sizeof(packed)) == size);
+
+	// The buffer holds no pointers, so it can be viewed anywhere
+	memcpy(moved, packed, size);
+	memset(packed, 0, sizeof(packed));
+
+	Opt_Slice slices[4];
+	Opt_Arena view_arena;
+	opt_arena_init(&view_arena, slices, sizeof(slices));
+
+	Opt_Result view;
+	Opt_Match view_matches[10];
+	CHECK(opt_result_view(&view, view_matches, LEN(view_matches), &view_arena, moved, size));
+	CHECK(strcmp(view.bin_name, "prog") == 0 && view.matches_len == 7 && view.simple == 1 && view.option == 5 && view.missing == 1);
+	CHECK(strcmp(view.matches[0].option.value.vstring, "x") == 0 && view.matches[1].option.value.vint == -7 && view.matches[2].option.value.vfloat == 0.5);
+	CHECK(view.matches[3].option.value.vlist.len == 3 && view.matches[3].option.value.vlist.ints[2] == 3);
+	CHECK(view.matches[4].option.value.vlist.len == 2 && view.matches[4].option.value.vlist.strings[1].len == 2);
+	CHECK(strncmp(view.matches[4].option.value.vlist.strings[1].ptr, "bc", 2) == 0);
+	CHECK(strcmp(view.matches[5].simple, "file") == 0 && view.matches[6].kind == OPT_MATCH_MISSING && view.matches[6].missing_opt == 5);
+
+	// Short buffers, short packs and damaged headers are refused
+	for (size_t len = 0; len < size; ++len) {
+		view_arena.len = 0;
+		CHECK(!opt_result_view(&view, view_matches, LEN(view_matches), &view_arena, moved, len));
+		CHECK(opt_result_pack(&result, packed, len) == size);
+	}
+
+	view_arena.len = 0;
+	CHECK(!opt_result_view(&view, view_matches, 6, &view_arena, moved, size));
+	CHECK(!opt_result_view(&view, view_matches, LEN(view_matches), NULL, moved, size));
+
+	memcpy(packed, moved, size);
+	packed[0] ^= 1;
+	CHECK(!opt_result_view(&view, view_matches, LEN(view_matches), &view_arena, packed, size));
+}
+
+int main(void) {
+	check_lists();
+	check_lazy();
+	check_cache();
+	check_cache_damage();
+	check_registry();
+	check_registry_threads();
+	check_pack();
+
+	if (failed != 0) {
+		fprintf(stderr, "%zu checks failed\n", failed);
+		return 1;
+	}
+
+	printf("All checks passed\n");
+	return 0;
+}
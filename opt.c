@@ -4,6 +4,28 @@
 #include <stdio.h>
 #include <string.h>
 #include <stdlib.h>
+#include <stdatomic.h>
+#include <pthread.h>
+#include <unistd.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <sys/file.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+// Aligned loads may read past the end of a string, which address sanitizers report
+#if defined(__SANITIZE_ADDRESS__)
+#define SCAN_SCALAR
+#elif defined(__has_feature)
+#if __has_feature(address_sanitizer)
+#define SCAN_SCALAR
+#endif
+#endif
+
+#if defined(__SSE2__) && !defined(SCAN_SCALAR)
+#define SCAN_SSE2
+#include <emmintrin.h>
+#endif
 
 #include "opt.h"
 
@@ -52,12 +74,24 @@ static inline Opt_Error error_missing(size_t opt, Opt_Value_Kind expected_value)
 	};
 }
 
-static inline Opt_Error error_invalid(Opt_Value_Kind expected_value, const char *base) {
+static inline Opt_Error error_invalid(Opt_Value_Kind expected_value, const char *base, size_t offset) {
 	return (Opt_Error) {
 		.kind = OPT_ERROR_INVALID_VALUE,
 		.invalid = {
 			.expected_value = expected_value,
 			.base = base,
+			.offset = offset,
+		},
+	};
+}
+
+static inline Opt_Error error_overflow(Opt_Value_Kind expected_value, const char *base, size_t offset) {
+	return (Opt_Error) {
+		.kind = OPT_ERROR_LIST_OVERFLOW,
+		.invalid = {
+			.expected_value = expected_value,
+			.base = base,
+			.offset = offset,
 		},
 	};
 }
@@ -89,25 +123,212 @@ static inline Opt_Match match_missing(size_t opt) {
 static inline Opt_Error int_read(int64_t *vint, const char *base) {
 	char *end = NULL;
 	*vint = strtol(base, &end, 0);
-	if (end[0] != '\0') return error_invalid(OPT_VALUE_INT, base);
+	if (end[0] != '\0') return error_invalid(OPT_VALUE_INT, base, end - base);
 	return error_none();
 }
 
 static inline Opt_Error float_read(double *vfloat, const char *base) {
 	char *end = NULL;
 	*vfloat = strtod(base, &end);
-	if (end[0] != '\0') return error_invalid(OPT_VALUE_FLOAT, base);
+	if (end[0] != '\0') return error_invalid(OPT_VALUE_FLOAT, base, end - base);
 	return error_none();
 }
 
 static inline Opt_Error bool_read(bool *vbool, const char *base) {
 	if (!strcmp(base, "t") || !strcmp(base, "T") || !strcmp(base, "true")) *vbool = true;
 	else if (!strcmp(base, "f") || !strcmp(base, "F") || !strcmp(base, "false")) *vbool = false;
-	else return error_invalid(OPT_VALUE_BOOL, base);
+	else return error_invalid(OPT_VALUE_BOOL, base, 0);
+	return error_none();
+}
+
+// Scans go through aligned blocks, which never cross the page holding the terminator
+static inline const char *scan_digits(const char *curr) {
+#ifdef SCAN_SSE2
+	const char *block = (const char *)((uintptr_t)curr & ~(uintptr_t)15);
+	unsigned skip = curr - block;
+
+	const __m128i zero = _mm_set1_epi8('0');
+	const __m128i nine = _mm_set1_epi8(9);
+
+	for (;; block += 16, skip = 0) {
+		__m128i bytes = _mm_sub_epi8(_mm_load_si128((const __m128i *)block), zero);
+		__m128i digits = _mm_cmpeq_epi8(_mm_min_epu8(bytes, nine), bytes);
+		unsigned mask = (~_mm_movemask_epi8(digits) & 0xffff) >> skip << skip;
+		if (mask != 0) return block + __builtin_ctz(mask);
+	}
+#else
+	while (curr[0] >= '0' && curr[0] <= '9') ++curr;
+	return curr;
+#endif
+}
+
+static inline const char *scan_sep(const char *curr, char sep) {
+#ifdef SCAN_SSE2
+	const char *block = (const char *)((uintptr_t)curr & ~(uintptr_t)15);
+	unsigned skip = curr - block;
+
+	const __m128i zero = _mm_setzero_si128();
+	const __m128i seps = _mm_set1_epi8(sep);
+
+	for (;; block += 16, skip = 0) {
+		__m128i bytes = _mm_load_si128((const __m128i *)block);
+		__m128i ends = _mm_or_si128(_mm_cmpeq_epi8(bytes, zero), _mm_cmpeq_epi8(bytes, seps));
+		unsigned mask = (unsigned)_mm_movemask_epi8(ends) >> skip << skip;
+		if (mask != 0) return block + __builtin_ctz(mask);
+	}
+#else
+	while (curr[0] != '\0' && curr[0] != sep) ++curr;
+	return curr;
+#endif
+}
+
+static inline uint64_t digits_read(const char *curr, size_t len) {
+	uint64_t vint = 0;
+
+#if __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+	// Eight digits at a time, combining pairs of lanes
+	for (; len >= 8; curr += 8, len -= 8) {
+		uint64_t chunk;
+		memcpy(&chunk, curr, 8);
+		chunk -= 0x3030303030303030;
+		chunk = (chunk * 10 + (chunk >> 8)) & 0x00ff00ff00ff00ff;
+		chunk = (chunk * 100 + (chunk >> 16)) & 0x0000ffff0000ffff;
+		chunk = (chunk * 10000 + (chunk >> 32)) & 0xffffffff;
+		vint = vint * 100000000 + chunk;
+	}
+#endif
+
+	for (; len > 0; ++curr, --len) vint = vint * 10 + (curr[0] - '0');
+	return vint;
+}
+
+// Returns the end of the element, or NULL if it is not an integer
+static inline const char *list_int_read(int64_t *vint, const char *curr) {
+	const char *start = curr;
+	bool negative = false;
+	if (curr[0] == '-' || curr[0] == '+') negative = *curr++ == '-';
+
+	if (curr[0] == '0' && ((curr[1] >= '0' && curr[1] <= '9') || curr[1] == 'x' || curr[1] == 'X')) {
+		// Prefixed integers are left to strtol, like single values
+		char *end = NULL;
+		errno = 0;
+		*vint = strtol(start, &end, 0);
+		return errno == 0 && end != curr ? end : NULL;
+	}
+
+	const char *end = scan_digits(curr);
+	size_t len = end - curr;
+	if (len == 0 || len > 19) return NULL;
+
+	uint64_t digits = digits_read(curr, len);
+	if (digits > (uint64_t)INT64_MAX + negative) return NULL;
+
+	*vint = negative ? -digits : digits;
+	return end;
+}
+
+static inline Opt_Error int_list_read(Opt_Value *value, const char *base) {
+	char sep = value->list_sep != '\0' ? value->list_sep : ',';
+	value->vlist.len = 0;
+	if (base[0] == '\0') return error_none();
+
+	for (const char *curr = base;; ++curr) {
+		int64_t first = 0;
+		int64_t last = 0;
+
+		const char *end = list_int_read(&first, curr);
+		if (end == NULL) return error_invalid(OPT_VALUE_INT_LIST, base, curr - base);
+		last = first;
+
+		if (end[0] == '-' && sep != '-') {
+			const char *range = end + 1;
+			end = list_int_read(&last, range);
+			if (end == NULL) return error_invalid(OPT_VALUE_INT_LIST, base, range - base);
+			if (last < first) return error_invalid(OPT_VALUE_INT_LIST, base, curr - base);
+		}
+
+		if (end[0] != sep && end[0] != '\0') return error_invalid(OPT_VALUE_INT_LIST, base, end - base);
+
+		if ((uint64_t)last - (uint64_t)first >= value->vlist.size - value->vlist.len) {
+			return error_overflow(OPT_VALUE_INT_LIST, base, curr - base);
+		}
+
+		if (value->vlist.ints == NULL) {
+			value->vlist.len += (uint64_t)last - (uint64_t)first + 1;
+		} else for (int64_t vint = first;; ++vint) {
+			value->vlist.ints[value->vlist.len++] = vint;
+			if (vint == last) break;
+		}
+
+		curr = end;
+		if (curr[0] == '\0') break;
+	}
+
+	return error_none();
+}
+
+static inline Opt_Error float_list_read(Opt_Value *value, const char *base) {
+	char sep = value->list_sep != '\0' ? value->list_sep : ',';
+	value->vlist.len = 0;
+	if (base[0] == '\0') return error_none();
+
+	for (const char *curr = base;; ++curr) {
+		const char *end = scan_sep(curr, sep);
+		if (end == curr) return error_invalid(OPT_VALUE_FLOAT_LIST, base, curr - base);
+
+		char *stop = NULL;
+		double vfloat = strtod(curr, &stop);
+
+		if (stop > end) {
+			// The separator may be part of a float, so the element is read on its own
+			char element[64];
+			if ((size_t)(end - curr) >= sizeof(element)) return error_invalid(OPT_VALUE_FLOAT_LIST, base, curr - base);
+
+			memcpy(element, curr, end - curr);
+			element[end - curr] = '\0';
+			vfloat = strtod(element, &stop);
+			stop = (char *)curr + (stop - element);
+		}
+
+		if (stop != end) return error_invalid(OPT_VALUE_FLOAT_LIST, base, stop - base);
+		if (value->vlist.len == value->vlist.size) return error_overflow(OPT_VALUE_FLOAT_LIST, base, curr - base);
+		if (value->vlist.floats != NULL) value->vlist.floats[value->vlist.len] = vfloat;
+		++value->vlist.len;
+
+		curr = end;
+		if (curr[0] == '\0') break;
+	}
+
+	return error_none();
+}
+
+static inline Opt_Error string_list_read(Opt_Value *value, const char *base) {
+	char sep = value->list_sep != '\0' ? value->list_sep : ',';
+	value->vlist.len = 0;
+	if (base[0] == '\0') return error_none();
+
+	for (const char *curr = base;; ++curr) {
+		const char *end = scan_sep(curr, sep);
+		if (value->vlist.len == value->vlist.size) return error_overflow(OPT_VALUE_STRING_LIST, base, curr - base);
+
+		if (value->vlist.strings != NULL) {
+			value->vlist.strings[value->vlist.len] = (Opt_Slice) {
+				.ptr = curr,
+				.len = end - curr,
+			};
+		}
+		++value->vlist.len;
+
+		curr = end;
+		if (curr[0] == '\0') break;
+	}
+
 	return error_none();
 }
 
 Opt_Error opt_value_read(Opt_Value *value, const char *base) {
+	value->lazy = false;
+
 	switch (value->kind) {
 		case OPT_VALUE_NONE:
 			break;
@@ -125,13 +346,66 @@ Opt_Error opt_value_read(Opt_Value *value, const char *base) {
 		case OPT_VALUE_BOOL:
 			return bool_read(&value->vbool, base);
 
+		case OPT_VALUE_INT_LIST:
+			return int_list_read(value, base);
+
+		case OPT_VALUE_FLOAT_LIST:
+			return float_list_read(value, base);
+
+		case OPT_VALUE_STRING_LIST:
+			return string_list_read(value, base);
+
 		default:
 			assert(true && "Unknown value kind");
 	}
 	return error_none();
 }
 
+static inline bool value_lazy(Opt_Value_Kind kind) {
+	return kind == OPT_VALUE_INT || kind == OPT_VALUE_FLOAT || kind == OPT_VALUE_BOOL;
+}
+
+Opt_Error opt_value_get(Opt_Value *value) {
+	if (!value->lazy) return error_none();
+
+	// A failed conversion keeps the raw token, so the error is the same on every access
+	const char *base = value->vstring;
+	Opt_Error error = opt_value_read(value, base);
+	if (error.kind != OPT_ERROR_NONE) {
+		value->lazy = true;
+		value->vstring = base;
+	}
+
+	return error;
+}
+
+Opt_Error opt_value_int(Opt_Value *value, int64_t *vint) {
+	assert(value->kind == OPT_VALUE_INT && "Value is not an int");
+	Opt_Error error = opt_value_get(value);
+	if (error.kind == OPT_ERROR_NONE) *vint = value->vint;
+	return error;
+}
+
+Opt_Error opt_value_float(Opt_Value *value, double *vfloat) {
+	assert(value->kind == OPT_VALUE_FLOAT && "Value is not a float");
+	Opt_Error error = opt_value_get(value);
+	if (error.kind == OPT_ERROR_NONE) *vfloat = value->vfloat;
+	return error;
+}
+
+Opt_Error opt_value_bool(Opt_Value *value, bool *vbool) {
+	assert(value->kind == OPT_VALUE_BOOL && "Value is not a bool");
+	Opt_Error error = opt_value_get(value);
+	if (error.kind == OPT_ERROR_NONE) *vbool = value->vbool;
+	return error;
+}
+
 void opt_value_print(Opt_Value value, FILE *file) {
+	if (value.lazy && opt_value_get(&value).kind != OPT_ERROR_NONE) {
+		fprintf(file, "'%s'", value.vstring);
+		return;
+	}
+
 	switch (value.kind) {
 		case OPT_VALUE_NONE:
 			fprintf(file, "none");
@@ -153,11 +427,39 @@ void opt_value_print(Opt_Value value, FILE *file) {
 			fprintf(file, "%s", value.vbool ? "true" : "false");
 			break;
 
+		case OPT_VALUE_INT_LIST:
+			fprintf(file, "[");
+			for (size_t i = 0; i < value.vlist.len; ++i) fprintf(file, i != 0 ? ", %ld" : "%ld", value.vlist.ints[i]);
+			fprintf(file, "]");
+			break;
+
+		case OPT_VALUE_FLOAT_LIST:
+			fprintf(file, "[");
+			for (size_t i = 0; i < value.vlist.len; ++i) fprintf(file, i != 0 ? ", %lf" : "%lf", value.vlist.floats[i]);
+			fprintf(file, "]");
+			break;
+
+		case OPT_VALUE_STRING_LIST:
+			fprintf(file, "[");
+			for (size_t i = 0; i < value.vlist.len; ++i) {
+				fprintf(file, i != 0 ? ", '%.*s'" : "'%.*s'", (int)value.vlist.strings[i].len, value.vlist.strings[i].ptr);
+			}
+			fprintf(file, "]");
+			break;
+
 		default:
 			assert(true && "Unknown value kind");
 	}
 }
 
+void opt_arena_init(Opt_Arena *arena, void *base, size_t size) {
+	arena->base = base;
+	arena->len = 0;
+	arena->size = size;
+
+	assert((base != NULL || size == 0) && "Arena without memory");
+}
+
 void opt_info_init(Opt_Info *info, const char *long_name, const char *short_name, const char *desc, Opt_Value_Kind value_kind, const char *value_name, Opt_Info_Flag flags) {
 	info->long_name = long_name;
 	info->long_len = long_name != NULL ? strlen(long_name) : 0;
@@ -167,7 +469,7 @@ void opt_info_init(Opt_Info *info, const char *long_name, const char *short_name
 	info->value_kind = value_kind;
 	info->value_name = value_name;
 	info->flags = flags;
-	info->_seen = 0;
+	info->list_sep = ',';
 
 	assert((short_name != NULL || long_name != NULL) && "No name given to option");
 
@@ -183,7 +485,7 @@ void opt_info_usage(Opt_Info *opts, size_t opts_len, Opt_Usage *usage, FILE *fil
 	size_t line_curr = fprintf(file, "Usage: %s", usage->name);
 	size_t line_pad = line_curr + 1;
 
-	const char *value[5] = { "", "string", "int", "float", "bool" };
+	const char *value[8] = { "", "string", "int", "float", "bool", "int,...", "float,...", "string,..." };
 
 	for (size_t opt = 0; opt < opts_len; ++opt) {
 		Opt_Info *info = &opts[opt];
@@ -362,19 +664,541 @@ void opt_result_iter(Opt_Result *result, Opt_Result_Simple_F simple_f, Opt_Resul
 	}
 }
 
+Opt_Error opt_result_validate(Opt_Result *result) {
+	for (size_t i = 0; i < result->matches_len; ++i) {
+		Opt_Match *match = &result->matches[i];
+		if (match->kind != OPT_MATCH_OPTION) continue;
+
+		Opt_Error error = opt_value_get(&match->option.value);
+		if (error.kind != OPT_ERROR_NONE) return error;
+	}
+
+	return error_none();
+}
+
 static inline void result_push(Opt_Result *result, Opt_Match match) {
 	assert((result->matches_len + 1 < result->matches_size) && "Too many matches");
 	result->matches[result->matches_len++] = match;
 }
 
+static inline uint64_t hash_bytes(uint64_t hash, const void *bytes, size_t len) {
+	const uint8_t *curr = bytes;
+	for (; len >= 8; curr += 8, len -= 8) {
+		uint64_t chunk;
+		memcpy(&chunk, curr, 8);
+		hash = (hash ^ chunk) * 0x9e3779b97f4a7c15;
+		hash ^= hash >> 29;
+	}
+
+	uint64_t chunk = (uint64_t)len << 56;
+	memcpy(&chunk, curr, len);
+	hash = (hash ^ chunk) * 0x9e3779b97f4a7c15;
+	return hash ^ (hash >> 32);
+}
+
+static inline uint64_t hash_u64(uint64_t hash, uint64_t value) {
+	return hash_bytes(hash, &value, sizeof(value));
+}
+
+static inline size_t list_item_size(Opt_Value_Kind kind) {
+	switch (kind) {
+		case OPT_VALUE_INT_LIST:
+			return sizeof(int64_t);
+
+		case OPT_VALUE_FLOAT_LIST:
+			return sizeof(double);
+
+		case OPT_VALUE_STRING_LIST:
+			return sizeof(Opt_Slice);
+
+		default:
+			return 0;
+	}
+}
+
+static inline size_t arena_start(Opt_Arena *arena) {
+	size_t align = sizeof(int64_t) - 1;
+	return (((uintptr_t)arena->base + arena->len + align) & ~(uintptr_t)align) - (uintptr_t)arena->base;
+}
+
+// A list takes all the arena left, and gives back what it did not use
+static inline void list_prepare(Opt_Parser *parser, Opt_Value *value) {
+	value->vlist.items = NULL;
+	value->vlist.len = 0;
+	value->vlist.size = 0;
+
+	Opt_Arena *arena = parser->arena;
+	if (arena == NULL) return;
+
+	size_t start = arena_start(arena);
+	if (start >= arena->size) return;
+
+	value->vlist.items = &arena->base[start];
+	value->vlist.size = (arena->size - start) / list_item_size(value->kind);
+}
+
+static inline void list_commit(Opt_Parser *parser, Opt_Value *value) {
+	if (parser->arena == NULL || value->vlist.items == NULL) return;
+	parser->arena->len = (char *)value->vlist.items - parser->arena->base + value->vlist.len * list_item_size(value->kind);
+}
+
+// Lists of ignored matches are only checked, and a replaced list gives its space to the new one
+static inline Opt_Error parser_value_read(Opt_Parser *parser, Opt_Info *info, Opt_Value *value, const char *base, Opt_Value *replaced, bool ignored) {
+	if (parser->lazy && value_lazy(value->kind)) {
+		value->lazy = true;
+		value->vstring = base;
+		return error_none();
+	}
+
+	if (list_item_size(value->kind) == 0) return opt_value_read(value, base);
+	value->list_sep = info->list_sep;
+
+	if (ignored) {
+		value->vlist.items = NULL;
+		value->vlist.size = SIZE_MAX;
+		return opt_value_read(value, base);
+	}
+
+	Opt_Arena *arena = parser->arena;
+	if (replaced != NULL && arena != NULL && replaced->vlist.items != NULL) {
+		char *end = (char *)replaced->vlist.items + replaced->vlist.len * list_item_size(value->kind);
+		if (end == &arena->base[arena->len]) {
+			arena->len = (char *)replaced->vlist.items - arena->base;
+		} else {
+			// Lists after it are still used, so the new list can only take its place if it fits
+			value->vlist.items = replaced->vlist.items;
+			value->vlist.size = replaced->vlist.len;
+
+			Opt_Error error = opt_value_read(value, base);
+			if (error.kind != OPT_ERROR_LIST_OVERFLOW) return error;
+		}
+	}
+
+	list_prepare(parser, value);
+	Opt_Error error = opt_value_read(value, base);
+	if (error.kind != OPT_ERROR_NONE) return error;
+
+	list_commit(parser, value);
+	return error_none();
+}
+
+// Tables are never written once published, removed options only leave their position empty
+struct Opt_Table {
+	Opt_Info *opts;
+	size_t *ids;
+	size_t opts_len;
+	size_t opts_size;
+	size_t removed;
+	size_t next_id;
+	size_t *long_index;
+	size_t *short_index;
+	size_t index_size;
+	size_t long_max;
+	size_t short_max;
+	uint64_t fingerprint;
+	struct Opt_Table *retired;
+};
+
+typedef struct {
+	size_t seen;
+	size_t match;
+} Run_State;
+
+#define RUN_STATES 256
+
+static inline size_t table_id(Opt_Table *table, size_t opt) {
+	return table->ids != NULL ? table->ids[opt] : opt;
+}
+
+static inline const char *info_name(Opt_Info *info, bool is_long, size_t *len) {
+	*len = is_long ? info->long_len : info->short_len;
+	return is_long ? info->long_name : info->short_name;
+}
+
+static Opt_Table *table_alloc(size_t opts_size, size_t index_size) {
+	size_t size = sizeof(Opt_Table) + opts_size * (sizeof(Opt_Info) + sizeof(size_t)) + 2 * index_size * sizeof(size_t);
+	Opt_Table *table = malloc(size);
+	if (table == NULL) return NULL;
+
+	table->opts = (Opt_Info *)(table + 1);
+	table->ids = (size_t *)(table->opts + opts_size);
+	table->long_index = table->ids + opts_size;
+	table->short_index = table->long_index + index_size;
+	table->opts_len = 0;
+	table->opts_size = opts_size;
+	table->removed = 0;
+	table->next_id = 0;
+	table->index_size = index_size;
+	table->long_max = 0;
+	table->short_max = 0;
+	table->fingerprint = 0;
+	table->retired = NULL;
+
+	memset(table->long_index, 0, 2 * index_size * sizeof(size_t));
+	return table;
+}
+
+// Names are hashed a byte at a time, so that every prefix of an argument is hashed in one pass
+#define INDEX_SEED 0xcbf29ce484222325
+
+static inline uint64_t index_step(uint64_t hash, char c) {
+	return (hash ^ (uint8_t)c) * 0x100000001b3;
+}
+
+static inline size_t index_slot(Opt_Table *table, uint64_t hash) {
+	return (hash ^ (hash >> 29)) & (table->index_size - 1);
+}
+
+// Indexes are open addressed with linear probing, and hold positions plus one
+static inline size_t index_home(Opt_Table *table, const char *name, size_t len) {
+	uint64_t hash = INDEX_SEED;
+	for (size_t i = 0; i < len; ++i) hash = index_step(hash, name[i]);
+	return index_slot(table, hash);
+}
+
+static size_t index_probe(Opt_Table *table, bool is_long, size_t slot, const char *name, size_t len) {
+	size_t *index = is_long ? table->long_index : table->short_index;
+	size_t mask = table->index_size - 1;
+
+	for (; index[slot] != 0; slot = (slot + 1) & mask) {
+		size_t info_len = 0;
+		const char *curr_name = info_name(&table->opts[index[slot] - 1], is_long, &info_len);
+		if (info_len == len && !memcmp(curr_name, name, len)) return index[slot] - 1;
+	}
+
+	return SIZE_MAX;
+}
+
+static inline size_t index_find(Opt_Table *table, bool is_long, const char *name, size_t len) {
+	return index_probe(table, is_long, index_home(table, name, len), name, len);
+}
+
+static void index_insert(Opt_Table *table, bool is_long, size_t opt) {
+	size_t len = 0;
+	const char *name = info_name(&table->opts[opt], is_long, &len);
+	if (len == 0) return;
+
+	size_t *max = is_long ? &table->long_max : &table->short_max;
+	if (len > *max) *max = len;
+
+	size_t *index = is_long ? table->long_index : table->short_index;
+	size_t mask = table->index_size - 1;
+
+	size_t slot = index_home(table, name, len);
+	while (index[slot] != 0) slot = (slot + 1) & mask;
+	index[slot] = opt + 1;
+}
+
+static void index_remove(Opt_Table *table, bool is_long, size_t opt) {
+	size_t len = 0;
+	const char *name = info_name(&table->opts[opt], is_long, &len);
+	if (len == 0) return;
+
+	size_t *index = is_long ? table->long_index : table->short_index;
+	size_t mask = table->index_size - 1;
+
+	size_t hole = index_home(table, name, len);
+	while (index[hole] != opt + 1) hole = (hole + 1) & mask;
+
+	// Entries after the hole move back, unless that would put them before their home
+	for (size_t slot = (hole + 1) & mask; index[slot] != 0; slot = (slot + 1) & mask) {
+		const char *curr_name = info_name(&table->opts[index[slot] - 1], is_long, &len);
+		size_t home = index_home(table, curr_name, len);
+		if (((slot - home) & mask) >= ((slot - hole) & mask)) {
+			index[hole] = index[slot];
+			hole = slot;
+		}
+	}
+
+	index[hole] = 0;
+}
+
+// Finds the first option whose name starts base, indexed tables look up every prefix of base to match the same way
+static bool table_find(Opt_Table *table, bool is_long, const char *base, size_t *opt, size_t *len) {
+	if (table->long_index == NULL) {
+		for (size_t curr = 0; curr < table->opts_len; ++curr) {
+			const char *name = info_name(&table->opts[curr], is_long, len);
+			if (*len != 0 && !strncmp(base, name, *len)) {
+				*opt = curr;
+				return true;
+			}
+		}
+
+		return false;
+	}
+
+	size_t max = is_long ? table->long_max : table->short_max;
+	uint64_t hash = INDEX_SEED;
+	*opt = SIZE_MAX;
+
+	for (size_t prefix = 1; prefix <= max && base[prefix - 1] != '\0'; ++prefix) {
+		hash = index_step(hash, base[prefix - 1]);
+		size_t found = index_probe(table, is_long, index_slot(table, hash), base, prefix);
+		if (found < *opt) {
+			*opt = found;
+			*len = prefix;
+		}
+	}
+
+	return *opt != SIZE_MAX;
+}
+
+static bool table_has_name(Opt_Table *table, bool is_long, const char *name, size_t len) {
+	if (len == 0) return false;
+	if (table->long_index != NULL) return index_find(table, is_long, name, len) != SIZE_MAX;
+
+	for (size_t opt = 0; opt < table->opts_len; ++opt) {
+		size_t info_len = 0;
+		const char *curr_name = info_name(&table->opts[opt], is_long, &info_len);
+		if (info_len == len && !memcmp(curr_name, name, len)) return true;
+	}
+
+	return false;
+}
+
+// Copies the options left and indexes them again, with room for extra ones
+static Opt_Table *table_rebuild(Opt_Table *old, size_t extra) {
+	size_t live = old->opts_len - old->removed;
+	size_t index_size = 16;
+	while (index_size < 2 * (live + extra)) index_size *= 2;
+
+	Opt_Table *table = table_alloc(live + extra, index_size);
+	if (table == NULL) return NULL;
+
+	for (size_t opt = 0; opt < old->opts_len; ++opt) {
+		size_t id = table_id(old, opt);
+		if (id == OPT_ID_NONE) continue;
+
+		table->opts[table->opts_len] = old->opts[opt];
+		table->ids[table->opts_len] = id;
+		index_insert(table, true, table->opts_len);
+		index_insert(table, false, table->opts_len);
+		++table->opts_len;
+	}
+
+	table->next_id = old->ids != NULL ? old->next_id : old->opts_len;
+	return table;
+}
+
+static Opt_Table *table_copy(Opt_Table *old, size_t extra) {
+	size_t live = old->opts_len - old->removed;
+	if (old->ids == NULL || 2 * (live + extra) > old->index_size || 2 * old->removed > old->opts_len) return table_rebuild(old, extra);
+
+	Opt_Table *table = table_alloc(old->opts_len + extra, old->index_size);
+	if (table == NULL) return NULL;
+
+	memcpy(table->opts, old->opts, old->opts_len * sizeof(Opt_Info));
+	memcpy(table->ids, old->ids, old->opts_len * sizeof(size_t));
+	memcpy(table->long_index, old->long_index, 2 * old->index_size * sizeof(size_t));
+	table->opts_len = old->opts_len;
+	table->removed = old->removed;
+	table->next_id = old->next_id;
+	table->long_max = old->long_max;
+	table->short_max = old->short_max;
+	return table;
+}
+
+// Parsers without added or removed options use their opts through a table on the stack
+static inline Opt_Table *table_view(Opt_Parser *parser, Opt_Table *table, Opt_Table *view) {
+	if (table != NULL) return table;
+
+	*view = (Opt_Table) {
+		.opts = parser->opts,
+		.opts_len = parser->opts_len,
+		.opts_size = parser->opts_len,
+		.fingerprint = __atomic_load_n(&parser->_fingerprint, __ATOMIC_RELAXED),
+	};
+	return view;
+}
+
+// Anything changing how the table parses changes its fingerprint, which is never 0
+static uint64_t table_fingerprint(Opt_Table *table) {
+	uint64_t hash = hash_u64(0, table->opts_len);
+	for (size_t opt = 0; opt < table->opts_len; ++opt) {
+		Opt_Info *info = &table->opts[opt];
+		if (table_id(table, opt) == OPT_ID_NONE) continue;
+
+		hash = hash_u64(hash, table_id(table, opt));
+		hash = hash_bytes(hash, info->long_name != NULL ? info->long_name : "", info->long_len + 1);
+		hash = hash_bytes(hash, info->short_name != NULL ? info->short_name : "", info->short_len + 1);
+		hash = hash_u64(hash, info->value_kind);
+		hash = hash_u64(hash, info->flags);
+		hash = hash_u64(hash, info->list_sep);
+	}
+
+	return hash != 0 ? hash : 1;
+}
+
+// Runs count themselves in the half of the current epoch before loading the table
+static Opt_Table *parser_enter(Opt_Parser *parser, Opt_Table *view, size_t *epoch) {
+	*epoch = __atomic_load_n(&parser->_epoch, __ATOMIC_SEQ_CST) & 1;
+	__atomic_add_fetch(&parser->_active[*epoch], 1, __ATOMIC_SEQ_CST);
+	return table_view(parser, __atomic_load_n(&parser->_table, __ATOMIC_SEQ_CST), view);
+}
+
+static inline void parser_leave(Opt_Parser *parser, size_t epoch) {
+	__atomic_sub_fetch(&parser->_active[epoch], 1, __ATOMIC_RELEASE);
+}
+
+static inline void parser_lock(Opt_Parser *parser) {
+	while (__atomic_test_and_set(&parser->_lock, __ATOMIC_ACQUIRE));
+}
+
+static inline void parser_unlock(Opt_Parser *parser) {
+	__atomic_clear(&parser->_lock, __ATOMIC_RELEASE);
+}
+
+static void tables_free(Opt_Table *tables) {
+	while (tables != NULL) {
+		Opt_Table *table = tables;
+		tables = table->retired;
+		free(table);
+	}
+}
+
+// Tables retired before the epoch moved on can go once the runs of the previous epoch end, which new runs do not delay
+static void parser_reclaim(Opt_Parser *parser) {
+	while (__atomic_load_n(&parser->_active[(parser->_epoch + 1) & 1], __ATOMIC_SEQ_CST) == 0) {
+		tables_free(parser->_draining);
+		parser->_draining = NULL;
+		if (parser->_retired == NULL) break;
+
+		parser->_draining = parser->_retired;
+		parser->_retired = NULL;
+		__atomic_store_n(&parser->_epoch, parser->_epoch + 1, __ATOMIC_SEQ_CST);
+	}
+}
+
+static void parser_publish(Opt_Parser *parser, Opt_Table *old, Opt_Table *table) {
+	table->fingerprint = table_fingerprint(table);
+	__atomic_store_n(&parser->_table, table, __ATOMIC_SEQ_CST);
+
+	if (old->ids != NULL) {
+		old->retired = parser->_retired;
+		parser->_retired = old;
+	}
+
+	parser_reclaim(parser);
+}
+
 void opt_parser_init(Opt_Parser *parser, Opt_Info *opts, size_t opts_len) {
 	parser->opts = opts;
 	parser->opts_len = opts_len;
+	parser->arena = NULL;
+	parser->lazy = false;
+	parser->_table = NULL;
+	parser->_retired = NULL;
+	parser->_draining = NULL;
+	parser->_fingerprint = 0;
+	parser->_epoch = 0;
+	parser->_active[0] = 0;
+	parser->_active[1] = 0;
+	parser->_lock = false;
 
 	//assert(opts != NULL && opts_len != 0);
 }
 
-Opt_Error opt_parser_run(Opt_Parser *parser, Opt_Result *result, const char **argv, const int argc) {
+size_t opt_parser_add(Opt_Parser *parser, const Opt_Info *info) {
+	parser_lock(parser);
+
+	Opt_Table view;
+	Opt_Table *old = table_view(parser, parser->_table, &view);
+
+	if (table_has_name(old, true, info->long_name, info->long_len) || table_has_name(old, false, info->short_name, info->short_len)) {
+		parser_unlock(parser);
+		return OPT_ID_NONE;
+	}
+
+	Opt_Table *table = table_copy(old, 1);
+	if (table == NULL) {
+		parser_unlock(parser);
+		return OPT_ID_NONE;
+	}
+
+	size_t opt = table->opts_len++;
+	size_t id = table->next_id++;
+	table->opts[opt] = *info;
+	table->ids[opt] = id;
+	index_insert(table, true, opt);
+	index_insert(table, false, opt);
+
+	parser_publish(parser, old, table);
+	parser_unlock(parser);
+	return id;
+}
+
+bool opt_parser_remove(Opt_Parser *parser, size_t id) {
+	parser_lock(parser);
+
+	Opt_Table view;
+	Opt_Table *old = table_view(parser, parser->_table, &view);
+
+	Opt_Table *table = id != OPT_ID_NONE ? table_copy(old, 0) : NULL;
+	size_t opt = 0;
+	while (table != NULL && opt < table->opts_len && table->ids[opt] != id) ++opt;
+
+	if (table == NULL || opt == table->opts_len) {
+		free(table);
+		parser_unlock(parser);
+		return false;
+	}
+
+	index_remove(table, true, opt);
+	index_remove(table, false, opt);
+	table->ids[opt] = OPT_ID_NONE;
+	++table->removed;
+
+	// Names of removed options may be freed once reclaimed, so no later table points at them
+	table->opts[opt].long_name = NULL;
+	table->opts[opt].long_len = 0;
+	table->opts[opt].short_name = NULL;
+	table->opts[opt].short_len = 0;
+
+	parser_publish(parser, old, table);
+	parser_unlock(parser);
+	return true;
+}
+
+size_t opt_parser_list(Opt_Parser *parser, Opt_Info *opts, size_t *ids, size_t opts_size) {
+	Opt_Table view;
+	size_t epoch = 0;
+	Opt_Table *table = parser_enter(parser, &view, &epoch);
+
+	size_t opts_len = 0;
+	for (size_t opt = 0; opt < table->opts_len; ++opt) {
+		size_t id = table_id(table, opt);
+		if (id == OPT_ID_NONE) continue;
+
+		if (opts_len < opts_size) {
+			if (opts != NULL) opts[opts_len] = table->opts[opt];
+			if (ids != NULL) ids[opts_len] = id;
+		}
+		++opts_len;
+	}
+
+	parser_leave(parser, epoch);
+	return opts_len;
+}
+
+bool opt_parser_reclaim(Opt_Parser *parser) {
+	parser_lock(parser);
+	parser_reclaim(parser);
+	bool reclaimed = parser->_retired == NULL && parser->_draining == NULL;
+	parser_unlock(parser);
+	return reclaimed;
+}
+
+void opt_parser_free(Opt_Parser *parser) {
+	assert(parser->_active[0] == 0 && parser->_active[1] == 0 && "Parser still running");
+	tables_free(parser->_retired);
+	tables_free(parser->_draining);
+	parser->_retired = NULL;
+	parser->_draining = NULL;
+	free(parser->_table);
+	parser->_table = NULL;
+}
+
+static Opt_Error parser_match(Opt_Parser *parser, Opt_Table *table, Run_State *states, Opt_Result *result, const char **argv, const int argc) {
 	result->bin_name = argv[0];
 	bool no_opt = false;
 
@@ -383,126 +1207,63 @@ Opt_Error opt_parser_run(Opt_Parser *parser, Opt_Result *result, const char **ar
 		Opt_Match match = { 0 };
 
 		if (argi[0] == '-' && !no_opt) {
-			bool found = false;
-			bool ignore = false;
+			if (argi[1] == '-' && argi[2] == '\0') {
+				no_opt = true;
+				continue;
+			}
 
-			if (argi[1] == '-') {
-				if (argi[2] == '\0') {
-					no_opt = true;
-					continue;
-				}
+			bool is_long = argi[1] == '-';
+			const char *base = &argi[is_long ? 2 : 1];
 
-				// long
-				const char *base = &argi[2];
-				for (size_t opt = 0; opt < parser->opts_len; ++opt) {
-					Opt_Info *info = &parser->opts[opt];
-					Opt_Value value = { 0 };
-
-					if (info->long_len == 0) continue;
-					if (!strncmp(base, info->long_name, info->long_len)) {
-						if (info->value_kind != OPT_VALUE_NONE) {
-							const char *base_value = NULL;
-							if (base[info->long_len] == '=') {
-								base_value = &base[info->long_len + 1];
-							} else if (arg + 1 < argc) base_value = argv[++arg];
-							else return error_missing(opt, info->value_kind);
-
-							value.kind = info->value_kind;
-							if (base[0] == '\0' && value.kind != OPT_VALUE_STRING) return error_missing(opt, value.kind);
-
-							Opt_Error error = opt_value_read(&value, base_value);
-							if (error.kind != OPT_ERROR_NONE) return error;
-						} else {
-							if (base[info->long_len] != '\0') return error_unknown(argi);
-							value = value_none();
-						}
-
-						if (info->flags & OPT_INFO_MATCH_NONE) {
-							ignore = true;
-							break;
-						}
-
-						match = match_option(opt, value);
-						found = true;
-
-						if (info->flags & OPT_INFO_STOP_PARSER) {
-							result_push(result, match);
-							return error_stopped();
-						}
-
-						if (info->_seen++ > 0) {
-							if (info->flags & OPT_INFO_MATCH_FIRST) {
-								ignore = true;
-								break;
-							} else if (info->flags & OPT_INFO_MATCH_LAST) {
-								memcpy(&result->matches[info->_match], &match, sizeof(Opt_Match));
-								ignore = true;
-								break;
-							} else if (info->flags & OPT_INFO_STOP_DUPLICATE) {
-								return error_duplicate(opt, value);
-							}
-						} else info->_match = result->matches_len;
-						break;
-					}
-				}
+			size_t opt = 0;
+			size_t len = 0;
+			if (!table_find(table, is_long, base, &opt, &len)) return error_unknown(argi);
+
+			Opt_Info *info = &table->opts[opt];
+			Run_State *state = &states[opt];
+			size_t id = table_id(table, opt);
+			Opt_Value value = { 0 };
+
+			if (info->value_kind != OPT_VALUE_NONE) {
+				const char *base_value = NULL;
+				if (base[len] == '=') {
+					base_value = &base[len + 1];
+				} else if (arg + 1 < argc) base_value = argv[++arg];
+				else return error_missing(id, info->value_kind);
+
+				value.kind = info->value_kind;
+				if (base[0] == '\0' && value.kind != OPT_VALUE_STRING) return error_missing(id, value.kind);
+
+				bool ignored = info->flags & OPT_INFO_MATCH_NONE || (state->seen > 0 && info->flags & OPT_INFO_MATCH_FIRST);
+				Opt_Value *replaced = state->seen > 0 && info->flags & OPT_INFO_MATCH_LAST ? &result->matches[state->match].option.value : NULL;
+
+				Opt_Error error = parser_value_read(parser, info, &value, base_value, replaced, ignored);
+				if (error.kind != OPT_ERROR_NONE) return error;
 			} else {
-				// short
-				const char *base = &argi[1];
-				for (size_t opt = 0; opt < parser->opts_len; ++opt) {
-					Opt_Info *info = &parser->opts[opt];
-					Opt_Value value = { 0 };
-
-					if (info->short_len == 0) continue;
-					if (!strncmp(base, info->short_name, info->short_len)) {
-						if (info->value_kind != OPT_VALUE_NONE) {
-							const char *base_value = NULL;
-							if (base[info->short_len] == '=') {
-								base_value = &base[info->short_len + 1];
-							} else if (arg + 1 < argc) base_value = argv[++arg];
-							else return error_missing(opt, info->value_kind);
-
-							value.kind = info->value_kind;
-							if (base[0] == '\0' && value.kind != OPT_VALUE_STRING) return error_missing(opt, value.kind);
-
-							Opt_Error error = opt_value_read(&value, base_value);
-							if (error.kind != OPT_ERROR_NONE) return error;
-						} else {
-							if (base[info->short_len] != '\0') return error_unknown(argi);
-							value = value_none();
-						}
-
-						if (info->flags & OPT_INFO_MATCH_NONE) {
-							ignore = true;
-							break;
-						}
-
-						match = match_option(opt, value);
-						found = true;
-
-						if (info->flags & OPT_INFO_STOP_PARSER) {
-							result_push(result, match);
-							return error_stopped();
-						}
-
-						if (info->_seen++ > 0) {
-							if (info->flags & OPT_INFO_MATCH_FIRST) {
-								ignore = true;
-								break;
-							} else if (info->flags & OPT_INFO_MATCH_LAST) {
-								memcpy(&result->matches[info->_match], &match, sizeof(Opt_Match));
-								ignore = true;
-								break;
-							} else if (info->flags & OPT_INFO_STOP_DUPLICATE) {
-								return error_duplicate(opt, value);
-							}
-						} else info->_match = result->matches_len;
-						break;
-					}
-				}
+				if (base[len] != '\0') return error_unknown(argi);
+				value = value_none();
+			}
+
+			if (info->flags & OPT_INFO_MATCH_NONE) continue;
+
+			match = match_option(id, value);
+
+			if (info->flags & OPT_INFO_STOP_PARSER) {
+				result_push(result, match);
+				return error_stopped();
 			}
 
-			if (ignore) continue;
-			if (!found) return error_unknown(argi);
+			if (state->seen++ > 0) {
+				if (info->flags & OPT_INFO_MATCH_FIRST) {
+					continue;
+				} else if (info->flags & OPT_INFO_MATCH_LAST) {
+					memcpy(&result->matches[state->match], &match, sizeof(Opt_Match));
+					continue;
+				} else if (info->flags & OPT_INFO_STOP_DUPLICATE) {
+					return error_duplicate(id, value);
+				}
+			} else state->match = result->matches_len;
+
 			++result->option;
 		} else {
 			match = match_simple(argi);
@@ -512,13 +1273,998 @@ Opt_Error opt_parser_run(Opt_Parser *parser, Opt_Result *result, const char **ar
 		result_push(result, match);
 	}
 
-	for (size_t opt = 0; opt < parser->opts_len; ++opt) {
-		Opt_Info *info = &parser->opts[opt];
-		if (info->_seen == 0 && info->flags & OPT_INFO_MATCH_MISSING) {
+	for (size_t opt = 0; opt < table->opts_len; ++opt) {
+		Opt_Info *info = &table->opts[opt];
+		size_t id = table_id(table, opt);
+		if (id != OPT_ID_NONE && states[opt].seen == 0 && info->flags & OPT_INFO_MATCH_MISSING) {
 			++result->missing;
-			result_push(result, match_missing(opt));
+			result_push(result, match_missing(id));
 		}
 	}
 
 	return error_none();
 }
+
+// Per run state lives outside the table, so that runs can share it
+static Opt_Error parser_run(Opt_Parser *parser, Opt_Table *table, Opt_Result *result, const char **argv, const int argc) {
+	Run_State states_stack[RUN_STATES];
+	Run_State *states = table->opts_len <= RUN_STATES ? states_stack : malloc(table->opts_len * sizeof(Run_State));
+	assert(states != NULL && "Out of memory");
+	memset(states, 0, table->opts_len * sizeof(Run_State));
+
+	Opt_Error error = parser_match(parser, table, states, result, argv, argc);
+	if (states != states_stack) free(states);
+	return error;
+}
+
+Opt_Error opt_parser_run(Opt_Parser *parser, Opt_Result *result, const char **argv, const int argc) {
+	Opt_Table view;
+	size_t epoch = 0;
+	Opt_Table *table = parser_enter(parser, &view, &epoch);
+	Opt_Error error = parser_run(parser, table, result, argv, argc);
+	parser_leave(parser, epoch);
+	return error;
+}
+
+bool opt_batch_init(Opt_Batch *batch, const char *buf, const size_t *records_size, size_t records_len) {
+	memset(batch, 0, sizeof(Opt_Batch));
+	if (records_len == 0) return true;
+
+	// Arguments must be terminated to be used in place, so every record ends with a NUL
+	size_t args_len = 0;
+	for (size_t record = 0, offset = 0; record < records_len; offset += records_size[record++]) {
+		const char *curr = &buf[offset];
+		const char *end = curr + records_size[record];
+		if (curr != end && end[-1] != '\0') return false;
+
+		for (; curr < end; curr += strlen(curr) + 1) ++args_len;
+	}
+
+	batch->args = malloc(args_len * sizeof(const char *));
+	batch->records_arg = malloc(records_len * sizeof(size_t));
+	batch->records_argc = malloc(records_len * sizeof(size_t));
+	if (batch->records_arg == NULL || batch->records_argc == NULL || (args_len != 0 && batch->args == NULL)) {
+		opt_batch_free(batch);
+		return false;
+	}
+
+	for (size_t record = 0, offset = 0; record < records_len; offset += records_size[record++]) {
+		batch->records_arg[record] = batch->args_len;
+		for (const char *curr = &buf[offset], *end = curr + records_size[record]; curr < end; curr += strlen(curr) + 1) {
+			batch->args[batch->args_len++] = curr;
+		}
+
+		batch->records_argc[record] = batch->args_len - batch->records_arg[record];
+	}
+
+	batch->records_len = records_len;
+	assert(batch->args_len == args_len);
+	return true;
+}
+
+#define BATCH_CHUNK 64
+#define BATCH_BLOCK_SIZE (64 * 1024)
+#define BATCH_ARENA_MAX (64 * 1024 * 1024)
+
+struct Opt_Batch_Block {
+	struct Opt_Batch_Block *next;
+	size_t len;
+	size_t size;
+	char data[];
+};
+
+typedef struct {
+	Opt_Batch *batch;
+	Opt_Parser parser;
+	Opt_Table *table;
+	size_t missing_len;
+	atomic_size_t next;
+	atomic_bool failed;
+} Batch_Shared;
+
+static Opt_Batch_Block *batch_block(Opt_Batch_Block **blocks, size_t size) {
+	if (size < BATCH_BLOCK_SIZE) size = BATCH_BLOCK_SIZE;
+
+	Opt_Batch_Block *block = malloc(sizeof(Opt_Batch_Block) + size);
+	if (block == NULL) return NULL;
+
+	block->next = *blocks;
+	block->len = 0;
+	block->size = size;
+	*blocks = block;
+	return block;
+}
+
+static void batch_blocks_free(Opt_Batch_Block *blocks) {
+	while (blocks != NULL) {
+		Opt_Batch_Block *next = blocks->next;
+		free(blocks);
+		blocks = next;
+	}
+}
+
+// Returns the blocks holding the matches and lists of the worker records
+static void *batch_worker(void *arg) {
+	Batch_Shared *shared = arg;
+	Opt_Batch *batch = shared->batch;
+	Opt_Batch_Block *blocks = NULL;
+	Opt_Batch_Block *matches_block = NULL;
+
+	Opt_Arena arena = { 0 };
+	Opt_Parser parser = shared->parser;
+	parser.arena = &arena;
+
+	for (;;) {
+		size_t first = atomic_fetch_add_explicit(&shared->next, BATCH_CHUNK, memory_order_relaxed);
+		if (first >= batch->records_len || atomic_load_explicit(&shared->failed, memory_order_relaxed)) break;
+
+		size_t last = first + BATCH_CHUNK < batch->records_len ? first + BATCH_CHUNK : batch->records_len;
+		for (size_t record = first; record < last; ++record) {
+			size_t argc = batch->records_argc[record];
+			batch->errors[record] = error_none();
+			batch->records_matches[record] = NULL;
+			batch->matches_count[record] = 0;
+
+			// Empty records, like the command line of a kernel thread, have nothing to parse
+			if (argc == 0) continue;
+
+			// Every record gets room for all its arguments and all the options that can be missing
+			size_t room = (argc + shared->missing_len) * sizeof(Opt_Match);
+			if (matches_block == NULL || matches_block->size - matches_block->len < room) matches_block = batch_block(&blocks, room);
+			if (matches_block == NULL) {
+				atomic_store_explicit(&shared->failed, true, memory_order_relaxed);
+				return blocks;
+			}
+
+			Opt_Result result;
+			for (;;) {
+				opt_result_init(&result, (Opt_Match *)&matches_block->data[matches_block->len], argc + shared->missing_len);
+
+				size_t arena_len = arena.len;
+				batch->errors[record] = parser_run(&parser, shared->table, &result, &batch->args[batch->records_arg[record]], argc);
+				if (batch->errors[record].kind != OPT_ERROR_LIST_OVERFLOW || (arena_len == 0 && arena.size >= BATCH_ARENA_MAX)) break;
+
+				// The record runs again in a new arena, twice as large if it did not fit in an empty one
+				Opt_Batch_Block *lists_block = batch_block(&blocks, arena_len == 0 ? arena.size * 2 : arena.size);
+				if (lists_block == NULL) {
+					atomic_store_explicit(&shared->failed, true, memory_order_relaxed);
+					return blocks;
+				}
+
+				opt_arena_init(&arena, lists_block->data, lists_block->size);
+			}
+
+			batch->records_matches[record] = result.matches;
+			batch->matches_count[record] = result.matches_len;
+			matches_block->len += result.matches_len * sizeof(Opt_Match);
+		}
+	}
+
+	return blocks;
+}
+
+bool opt_batch_run(Opt_Batch *batch, Opt_Parser *parser, size_t threads) {
+	if (threads == 0) {
+		long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+		threads = cpus > 0 ? cpus : 1;
+	}
+
+	free(batch->errors);
+	free(batch->records_matches);
+	free(batch->matches_count);
+	batch_blocks_free(batch->_blocks);
+	batch->_blocks = NULL;
+
+	// Workers share the table, but each one has its own arena
+	Opt_Table view;
+	size_t epoch = 0;
+	Batch_Shared shared = {
+		.batch = batch,
+		.parser = {
+			.lazy = parser->lazy,
+		},
+		.table = parser_enter(parser, &view, &epoch),
+	};
+	atomic_init(&shared.next, 0);
+	atomic_init(&shared.failed, false);
+
+	for (size_t opt = 0; opt < shared.table->opts_len; ++opt) {
+		if (table_id(shared.table, opt) != OPT_ID_NONE && shared.table->opts[opt].flags & OPT_INFO_MATCH_MISSING) ++shared.missing_len;
+	}
+
+	batch->errors = malloc(batch->records_len * sizeof(Opt_Error));
+	batch->records_matches = malloc(batch->records_len * sizeof(Opt_Match *));
+	batch->matches_count = malloc(batch->records_len * sizeof(size_t));
+
+	if (batch->records_len != 0 && (batch->errors == NULL || batch->records_matches == NULL || batch->matches_count == NULL)) {
+		parser_leave(parser, epoch);
+		return false;
+	}
+
+	size_t workers_len = batch->records_len / BATCH_CHUNK < threads - 1 ? batch->records_len / BATCH_CHUNK : threads - 1;
+	pthread_t *workers = workers_len != 0 ? malloc(workers_len * sizeof(pthread_t)) : NULL;
+	if (workers == NULL) workers_len = 0;
+
+	size_t spawned = 0;
+	while (spawned < workers_len && !pthread_create(&workers[spawned], NULL, batch_worker, &shared)) ++spawned;
+
+	// The calling thread is always working, the blocks of all workers end up in one list
+	batch->_blocks = batch_worker(&shared);
+
+	for (size_t worker = 0; worker < spawned; ++worker) {
+		void *blocks;
+		pthread_join(workers[worker], &blocks);
+
+		Opt_Batch_Block **tail = &batch->_blocks;
+		while (*tail != NULL) tail = &(*tail)->next;
+		*tail = blocks;
+	}
+
+	free(workers);
+	parser_leave(parser, epoch);
+
+	return !atomic_load_explicit(&shared.failed, memory_order_relaxed);
+}
+
+void opt_batch_result(Opt_Batch *batch, size_t record, Opt_Result *result) {
+	assert(record < batch->records_len && "Record out of bounds");
+	assert(batch->matches_count != NULL && "Batch not run");
+
+	result->bin_name = batch->records_argc[record] != 0 ? batch->args[batch->records_arg[record]] : NULL;
+	result->matches = batch->records_matches[record];
+	result->matches_len = batch->matches_count[record];
+	result->matches_size = result->matches_len;
+	result->simple = 0;
+	result->option = 0;
+	result->missing = 0;
+
+	for (size_t i = 0; i < result->matches_len; ++i) {
+		switch (result->matches[i].kind) {
+			case OPT_MATCH_SIMPLE:
+				++result->simple;
+				break;
+
+			case OPT_MATCH_OPTION:
+				++result->option;
+				break;
+
+			case OPT_MATCH_MISSING:
+				++result->missing;
+				break;
+
+			default:
+				assert(false && "Unreachable");
+		}
+	}
+}
+
+void opt_batch_free(Opt_Batch *batch) {
+	free(batch->args);
+	free(batch->records_arg);
+	free(batch->records_argc);
+	free(batch->errors);
+	free(batch->records_matches);
+	free(batch->matches_count);
+	batch_blocks_free(batch->_blocks);
+	memset(batch, 0, sizeof(Opt_Batch));
+}
+
+#define CACHE_MAGIC 0x454843414354504f
+#define CACHE_VERSION 2
+#define CACHE_SLOT_SIZE 4096
+
+typedef struct {
+	uint64_t magic;
+	uint32_t version;
+	uint32_t slots_len;
+	Opt_Cache_Stats stats;
+	uint8_t _pad[16];
+} Cache_Header;
+
+typedef struct {
+	uint64_t key;
+	uint64_t check;
+	uint32_t len;
+	uint32_t _pad;
+	uint8_t data[CACHE_SLOT_SIZE - 24];
+} Cache_Slot;
+
+typedef struct {
+	uint32_t argc;
+	uint32_t error;
+	uint32_t matches_len;
+	uint32_t simple;
+	uint32_t option;
+	uint32_t missing;
+} Cache_Entry;
+
+// Pointers are kept as argument index and offset, and rebased on the argv of the hit
+typedef struct {
+	uint8_t kind;
+	uint8_t value_kind;
+	uint8_t lazy;
+	uint8_t list_sep;
+	uint32_t index;
+	uint32_t arg;
+	uint32_t offset;
+	uint32_t len;
+	uint32_t _pad;
+	uint64_t raw;
+} Cache_Match;
+
+typedef struct {
+	uint32_t arg;
+	uint32_t offset;
+	uint32_t len;
+} Cache_Ref;
+
+// Published tables are fingerprinted once, the opts of a parser on its first cached run
+static uint64_t cache_key(Opt_Parser *parser, Opt_Table *table, const char **argv, const int argc) {
+	if (table->fingerprint == 0) {
+		table->fingerprint = table_fingerprint(table);
+		__atomic_store_n(&parser->_fingerprint, table->fingerprint, __ATOMIC_RELAXED);
+	}
+
+	uint64_t hash = hash_u64(table->fingerprint, parser->lazy);
+	hash = hash_u64(hash, argc);
+	for (int arg = 0; arg < argc; ++arg) hash = hash_bytes(hash, argv[arg], strlen(argv[arg]) + 1);
+
+	return hash != 0 ? hash : 1;
+}
+
+// Lays out an empty cache in fd, or in a new file that then takes the name of path
+static int cache_layout(int fd, const char *path, mode_t mode, size_t slots_len, bool replace) {
+	char *tmp = NULL;
+	if (replace) {
+		size_t len = strlen(path);
+		tmp = malloc(len + sizeof(".XXXXXX"));
+		if (tmp == NULL) return -1;
+
+		memcpy(tmp, path, len);
+		memcpy(&tmp[len], ".XXXXXX", sizeof(".XXXXXX"));
+		fd = mkstemp(tmp);
+		if (fd < 0) {
+			free(tmp);
+			return -1;
+		}
+	}
+
+	Cache_Header header = {
+		.magic = CACHE_MAGIC,
+		.version = CACHE_VERSION,
+		.slots_len = slots_len,
+	};
+
+	size_t map_size = sizeof(Cache_Header) + slots_len * sizeof(Cache_Slot);
+	bool done = ftruncate(fd, map_size) == 0 && pwrite(fd, &header, sizeof(header), 0) == sizeof(header);
+
+	if (replace) {
+		done = done && fchmod(fd, mode) == 0 && rename(tmp, path) == 0;
+		if (!done) {
+			unlink(tmp);
+			close(fd);
+		}
+		free(tmp);
+	}
+
+	return done ? fd : -1;
+}
+
+bool opt_cache_open(Opt_Cache *cache, const char *path, size_t slots_len) {
+	memset(cache, 0, sizeof(Opt_Cache));
+	assert(slots_len != 0 && slots_len <= UINT32_MAX && "Invalid cache size");
+
+	// Only one process lays out a new or stale file, and a file replaced while waiting is opened again
+	int fd = -1;
+	struct stat st;
+	for (;;) {
+		fd = open(path, O_RDWR | O_CREAT, 0644);
+		if (fd < 0) return false;
+
+		struct stat path_st;
+		if (flock(fd, LOCK_EX) < 0 || fstat(fd, &st) < 0 || stat(path, &path_st) < 0) {
+			close(fd);
+			return false;
+		}
+
+		if (st.st_dev == path_st.st_dev && st.st_ino == path_st.st_ino) break;
+		close(fd);
+	}
+
+	Cache_Header header = { 0 };
+
+	// A file laid out by another process keeps its size
+	bool valid = pread(fd, &header, sizeof(header), 0) == sizeof(header) && header.magic == CACHE_MAGIC && header.version == CACHE_VERSION;
+	valid = valid && header.slots_len != 0 && (size_t)st.st_size == sizeof(Cache_Header) + header.slots_len * sizeof(Cache_Slot);
+
+	if (valid) {
+		slots_len = header.slots_len;
+	} else {
+		// Other processes may have a stale file mapped, so it is replaced rather than truncated under them
+		int layout = cache_layout(fd, path, st.st_mode & 0777, slots_len, st.st_size != 0);
+		if (layout != fd) close(fd);
+		if (layout < 0) return false;
+		fd = layout;
+	}
+
+	flock(fd, LOCK_UN);
+
+	size_t map_size = sizeof(Cache_Header) + slots_len * sizeof(Cache_Slot);
+	void *map = mmap(NULL, map_size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+	close(fd);
+	if (map == MAP_FAILED) return false;
+
+	cache->map = map;
+	cache->map_size = map_size;
+	cache->slots_len = slots_len;
+	return true;
+}
+
+void opt_cache_close(Opt_Cache *cache) {
+	if (cache->map != NULL) munmap(cache->map, cache->map_size);
+	cache->map = NULL;
+	cache->map_size = 0;
+}
+
+void opt_cache_stats(Opt_Cache *cache, Opt_Cache_Stats *stats) {
+	if (cache->map == NULL) {
+		*stats = cache->stats;
+		return;
+	}
+
+	Cache_Header *header = cache->map;
+	stats->hits = __atomic_load_n(&header->stats.hits, __ATOMIC_RELAXED);
+	stats->misses = __atomic_load_n(&header->stats.misses, __ATOMIC_RELAXED);
+	stats->stores = __atomic_load_n(&header->stats.stores, __ATOMIC_RELAXED);
+	stats->oversized = __atomic_load_n(&header->stats.oversized, __ATOMIC_RELAXED);
+}
+
+#define CACHE_WAYS 4
+
+// Slots are checked on every hit, so four lanes are hashed at once
+static uint64_t cache_check(uint64_t key, const uint8_t *data, size_t len) {
+	uint64_t lanes[4] = { key, key + 1, key + 2, key + 3 };
+	for (; len >= sizeof(lanes); data += sizeof(lanes), len -= sizeof(lanes)) {
+		uint64_t chunks[4];
+		memcpy(chunks, data, sizeof(chunks));
+		for (size_t lane = 0; lane < 4; ++lane) {
+			lanes[lane] = (lanes[lane] ^ chunks[lane]) * 0x9e3779b97f4a7c15;
+			lanes[lane] ^= lanes[lane] >> 29;
+		}
+	}
+
+	uint64_t hash = hash_bytes(lanes[0], data, len);
+	for (size_t lane = 1; lane < 4; ++lane) hash = hash_u64(hash, lanes[lane]);
+	return hash;
+}
+
+static inline Cache_Slot *cache_slot(Opt_Cache *cache, uint64_t key, size_t way) {
+	Cache_Slot *slots = (Cache_Slot *)((Cache_Header *)cache->map + 1);
+	return &slots[(key + way) % cache->slots_len];
+}
+
+static bool cache_ref(const char *ptr, const char **argv, const int argc, size_t *lens, uint32_t *arg, uint32_t *offset) {
+	// Matches mostly follow argv, so the search starts from the last argument found
+	for (int i = 0; i < argc; ++i) {
+		int curr = (*arg + i) % argc;
+		if (ptr >= argv[curr] && ptr <= argv[curr] + lens[curr]) {
+			*arg = curr;
+			*offset = ptr - argv[curr];
+			return true;
+		}
+	}
+
+	return false;
+}
+
+static size_t cache_encode(uint8_t *data, size_t size, bool *oversized, Opt_Error error, Opt_Result *result, size_t first, const char **argv, const int argc) {
+	size_t matches_len = result->matches_len - first;
+	size_t len = sizeof(Cache_Entry) + matches_len * sizeof(Cache_Match);
+	*oversized = len > size;
+	if (*oversized) return 0;
+
+	size_t *lens = malloc(argc * sizeof(size_t));
+	if (lens == NULL) return 0;
+	for (int arg = 0; arg < argc; ++arg) lens[arg] = strlen(argv[arg]);
+
+	Cache_Entry entry = {
+		.argc = argc,
+		.error = error.kind,
+		.matches_len = matches_len,
+	};
+
+	uint32_t arg = 0;
+	uint32_t offset = 0;
+
+	for (size_t i = 0; i < matches_len; ++i) {
+		Opt_Match *match = &result->matches[first + i];
+		Cache_Match cached = {
+			.kind = match->kind,
+		};
+
+		if (match->kind == OPT_MATCH_SIMPLE) {
+			++entry.simple;
+			if (!cache_ref(match->simple, argv, argc, lens, &arg, &offset)) goto fail;
+			cached.arg = arg;
+			cached.offset = offset;
+		} else if (match->kind == OPT_MATCH_MISSING) {
+			++entry.missing;
+			cached.index = match->missing_opt;
+		} else {
+			++entry.option;
+			Opt_Value *value = &match->option.value;
+			cached.index = match->option.opt;
+			cached.value_kind = value->kind;
+			cached.lazy = value->lazy;
+			cached.list_sep = value->list_sep;
+
+			if (value->lazy || value->kind == OPT_VALUE_STRING) {
+				if (!cache_ref(value->vstring, argv, argc, lens, &arg, &offset)) goto fail;
+				cached.arg = arg;
+				cached.offset = offset;
+			} else if (value->kind == OPT_VALUE_INT || value->kind == OPT_VALUE_FLOAT) {
+				memcpy(&cached.raw, &value->vint, sizeof(cached.raw));
+			} else if (value->kind == OPT_VALUE_BOOL) {
+				cached.raw = value->vbool;
+			} else if (value->kind == OPT_VALUE_INT_LIST || value->kind == OPT_VALUE_FLOAT_LIST) {
+				size_t items_size = value->vlist.len * sizeof(int64_t);
+				*oversized = len + items_size > size;
+				if (*oversized) goto fail;
+
+				cached.len = value->vlist.len;
+				cached.raw = len;
+				memcpy(&data[len], value->vlist.items, items_size);
+				len += items_size;
+			} else if (value->kind == OPT_VALUE_STRING_LIST) {
+				size_t items_size = value->vlist.len * sizeof(Cache_Ref);
+				*oversized = len + items_size > size;
+				if (*oversized) goto fail;
+
+				cached.len = value->vlist.len;
+				cached.raw = len;
+				for (size_t item = 0; item < value->vlist.len; ++item) {
+					Opt_Slice *slice = &value->vlist.strings[item];
+					if (!cache_ref(slice->ptr, argv, argc, lens, &arg, &offset)) goto fail;
+
+					Cache_Ref ref = {
+						.arg = arg,
+						.offset = offset,
+						.len = slice->len,
+					};
+					memcpy(&data[len], &ref, sizeof(ref));
+					len += sizeof(ref);
+				}
+			}
+		}
+
+		memcpy(&data[sizeof(Cache_Entry) + i * sizeof(Cache_Match)], &cached, sizeof(cached));
+	}
+
+	memcpy(data, &entry, sizeof(entry));
+	free(lens);
+	return len;
+
+fail:
+	free(lens);
+	return 0;
+}
+
+// Pointers rebased on the argv of the hit must stay inside their argument
+static inline bool cache_rebase(const char **argv, const int argc, uint32_t arg, uint32_t offset, uint32_t len) {
+	if (arg >= (uint32_t)argc) return false;
+	size_t arg_len = strlen(argv[arg]);
+	return offset <= arg_len && len <= arg_len - offset;
+}
+
+static bool cache_decode(const uint8_t *data, size_t len, Opt_Error *error, Opt_Parser *parser, Opt_Table *table, Opt_Result *result, const char **argv, const int argc) {
+	Cache_Entry entry;
+	if (len < sizeof(entry)) return false;
+	memcpy(&entry, data, sizeof(entry));
+
+	if (entry.argc != (uint32_t)argc || len < sizeof(Cache_Entry) + entry.matches_len * sizeof(Cache_Match)) return false;
+	if (result->matches_len + entry.matches_len >= result->matches_size) return false;
+	if (entry.error != OPT_ERROR_NONE && entry.error != OPT_ERROR_STOPPED) return false;
+
+	// Ids of added options are covered by the key, but still must have been given out
+	size_t ids_len = table->ids != NULL ? table->next_id : table->opts_len;
+
+	// Lists decoded before a failure give back their arena space
+	size_t arena_len = parser->arena != NULL ? parser->arena->len : 0;
+	Opt_Match *matches = &result->matches[result->matches_len];
+
+	for (size_t i = 0; i < entry.matches_len; ++i) {
+		Cache_Match cached;
+		memcpy(&cached, &data[sizeof(Cache_Entry) + i * sizeof(Cache_Match)], sizeof(cached));
+
+		if (cached.kind == OPT_MATCH_SIMPLE) {
+			if (!cache_rebase(argv, argc, cached.arg, cached.offset, 0)) goto fail;
+			matches[i] = match_simple(argv[cached.arg] + cached.offset);
+			continue;
+		}
+
+		if (cached.index >= ids_len) goto fail;
+
+		if (cached.kind == OPT_MATCH_MISSING) {
+			matches[i] = match_missing(cached.index);
+			continue;
+		}
+
+		if (cached.kind != OPT_MATCH_OPTION || cached.value_kind > OPT_VALUE_STRING_LIST || cached.lazy > 1) goto fail;
+
+		Opt_Value value = {
+			.kind = cached.value_kind,
+			.lazy = cached.lazy,
+			.list_sep = cached.list_sep,
+		};
+
+		if (value.lazy || value.kind == OPT_VALUE_STRING) {
+			if (!cache_rebase(argv, argc, cached.arg, cached.offset, 0)) goto fail;
+			value.vstring = argv[cached.arg] + cached.offset;
+		} else if (value.kind == OPT_VALUE_INT || value.kind == OPT_VALUE_FLOAT) {
+			memcpy(&value.vint, &cached.raw, sizeof(cached.raw));
+		} else if (value.kind == OPT_VALUE_BOOL) {
+			value.vbool = cached.raw;
+		} else if (list_item_size(value.kind) != 0) {
+			size_t items_size = cached.len * (value.kind == OPT_VALUE_STRING_LIST ? sizeof(Cache_Ref) : sizeof(int64_t));
+			if (cached.raw > len || items_size > len - cached.raw) goto fail;
+
+			list_prepare(parser, &value);
+			if (value.vlist.size < cached.len) goto fail;
+
+			if (value.kind == OPT_VALUE_STRING_LIST) {
+				for (size_t item = 0; item < cached.len; ++item) {
+					Cache_Ref ref;
+					memcpy(&ref, &data[cached.raw + item * sizeof(ref)], sizeof(ref));
+					if (!cache_rebase(argv, argc, ref.arg, ref.offset, ref.len)) goto fail;
+
+					value.vlist.strings[item] = (Opt_Slice) {
+						.ptr = argv[ref.arg] + ref.offset,
+						.len = ref.len,
+					};
+				}
+			} else memcpy(value.vlist.items, &data[cached.raw], items_size);
+
+			value.vlist.len = cached.len;
+			list_commit(parser, &value);
+		}
+
+		matches[i] = match_option(cached.index, value);
+	}
+
+	result->bin_name = argv[0];
+	result->matches_len += entry.matches_len;
+	result->simple += entry.simple;
+	result->option += entry.option;
+	result->missing += entry.missing;
+	*error = (Opt_Error) {
+		.kind = entry.error,
+	};
+	return true;
+
+fail:
+	if (parser->arena != NULL) parser->arena->len = arena_len;
+	return false;
+}
+
+static Opt_Error cache_run(Opt_Cache *cache, Opt_Parser *parser, Opt_Table *table, Opt_Result *result, const char **argv, const int argc) {
+	if (cache->map == NULL) {
+		++cache->stats.misses;
+		return parser_run(parser, table, result, argv, argc);
+	}
+
+	Cache_Header *header = cache->map;
+	uint64_t key = cache_key(parser, table, argv, argc);
+
+	// Slots are copied out and checked, a torn write only shows up as a miss
+	uint8_t data[sizeof(((Cache_Slot *)NULL)->data)];
+	for (size_t way = 0; way < CACHE_WAYS; ++way) {
+		Cache_Slot *slot = cache_slot(cache, key, way);
+		if (__atomic_load_n(&slot->key, __ATOMIC_ACQUIRE) != key) continue;
+
+		uint64_t check = __atomic_load_n(&slot->check, __ATOMIC_ACQUIRE);
+		size_t len = __atomic_load_n(&slot->len, __ATOMIC_ACQUIRE);
+		if (len > sizeof(data)) continue;
+
+		memcpy(data, slot->data, len);
+		__atomic_thread_fence(__ATOMIC_ACQUIRE);
+
+		Opt_Error error;
+		if (__atomic_load_n(&slot->key, __ATOMIC_RELAXED) == key && cache_check(key, data, len) == check && cache_decode(data, len, &error, parser, table, result, argv, argc)) {
+			++cache->stats.hits;
+			__atomic_fetch_add(&header->stats.hits, 1, __ATOMIC_RELAXED);
+			return error;
+		}
+	}
+
+	++cache->stats.misses;
+	__atomic_fetch_add(&header->stats.misses, 1, __ATOMIC_RELAXED);
+
+	size_t first = result->matches_len;
+	Opt_Error error = parser_run(parser, table, result, argv, argc);
+	if (error.kind != OPT_ERROR_NONE && error.kind != OPT_ERROR_STOPPED) return error;
+
+	bool oversized = false;
+	size_t len = cache_encode(data, sizeof(data), &oversized, error, result, first, argv, argc);
+	if (oversized) {
+		++cache->stats.oversized;
+		__atomic_fetch_add(&header->stats.oversized, 1, __ATOMIC_RELAXED);
+	}
+	if (len == 0) return error;
+
+	// Free slots or the one holding the key are taken first, otherwise the key picks one to evict
+	Cache_Slot *slot = cache_slot(cache, key, (key >> 32) % CACHE_WAYS);
+	for (size_t way = 0; way < CACHE_WAYS; ++way) {
+		uint64_t slot_key = __atomic_load_n(&cache_slot(cache, key, way)->key, __ATOMIC_RELAXED);
+		if (slot_key == 0 || slot_key == key) {
+			slot = cache_slot(cache, key, way);
+			break;
+		}
+	}
+
+	__atomic_store_n(&slot->key, 0, __ATOMIC_RELEASE);
+	__atomic_store_n(&slot->len, len, __ATOMIC_RELAXED);
+	memcpy(slot->data, data, len);
+	__atomic_store_n(&slot->check, cache_check(key, data, len), __ATOMIC_RELEASE);
+	__atomic_store_n(&slot->key, key, __ATOMIC_RELEASE);
+
+	++cache->stats.stores;
+	__atomic_fetch_add(&header->stats.stores, 1, __ATOMIC_RELAXED);
+	return error;
+}
+
+Opt_Error opt_cache_run(Opt_Cache *cache, Opt_Parser *parser, Opt_Result *result, const char **argv, const int argc) {
+	// The key and the run on a miss must see the same table
+	Opt_Table view;
+	size_t epoch = 0;
+	Opt_Table *table = parser_enter(parser, &view, &epoch);
+	Opt_Error error = cache_run(cache, parser, table, result, argv, argc);
+	parser_leave(parser, epoch);
+	return error;
+}
+
+#define PACK_MAGIC 0x5254504f
+#define PACK_VERSION 1
+
+typedef struct {
+	uint32_t magic;
+	uint32_t version;
+	uint64_t size;
+	uint64_t bin_name;
+	uint64_t matches_len;
+	uint64_t simple;
+	uint64_t option;
+	uint64_t missing;
+	uint64_t slices_len;
+} Pack_Header;
+
+// Offsets are from the start of the buffer, strings are kept with their terminator
+typedef struct {
+	uint8_t kind;
+	uint8_t value_kind;
+	uint8_t lazy;
+	uint8_t list_sep;
+	uint32_t _pad;
+	uint64_t opt;
+	uint64_t raw;
+	uint64_t len;
+} Pack_Match;
+
+typedef struct {
+	uint64_t offset;
+	uint64_t len;
+} Pack_Slice;
+
+typedef struct {
+	uint8_t *buf;
+	size_t size;
+	size_t len;
+} Pack;
+
+// Space is always counted, but only written when it fits
+static inline size_t pack_reserve(Pack *pack, size_t len) {
+	size_t offset = (pack->len + sizeof(uint64_t) - 1) & ~(sizeof(uint64_t) - 1);
+	pack->len = offset + len;
+	return offset;
+}
+
+static inline bool pack_fits(Pack *pack, size_t offset, size_t len) {
+	return pack->buf != NULL && offset + len <= pack->size;
+}
+
+static uint64_t pack_string(Pack *pack, const char *str, size_t len) {
+	size_t offset = pack->len;
+	pack->len += len + 1;
+
+	if (pack_fits(pack, offset, len + 1)) {
+		memcpy(&pack->buf[offset], str, len);
+		pack->buf[offset + len] = '\0';
+	}
+
+	return offset;
+}
+
+size_t opt_result_pack(Opt_Result *result, void *buf, size_t size) {
+	Pack pack = {
+		.buf = buf,
+		.size = size,
+	};
+
+	Pack_Header header = {
+		.magic = PACK_MAGIC,
+		.version = PACK_VERSION,
+		.matches_len = result->matches_len,
+		.simple = result->simple,
+		.option = result->option,
+		.missing = result->missing,
+	};
+
+	size_t header_offset = pack_reserve(&pack, sizeof(Pack_Header));
+	size_t matches_offset = pack_reserve(&pack, result->matches_len * sizeof(Pack_Match));
+	if (result->bin_name != NULL) header.bin_name = pack_string(&pack, result->bin_name, strlen(result->bin_name));
+
+	for (size_t i = 0; i < result->matches_len; ++i) {
+		Opt_Match *match = &result->matches[i];
+		Pack_Match packed = {
+			.kind = match->kind,
+		};
+
+		if (match->kind == OPT_MATCH_SIMPLE) {
+			packed.raw = pack_string(&pack, match->simple, strlen(match->simple));
+		} else if (match->kind == OPT_MATCH_MISSING) {
+			packed.opt = match->missing_opt;
+		} else {
+			Opt_Value *value = &match->option.value;
+			packed.opt = match->option.opt;
+			packed.value_kind = value->kind;
+			packed.lazy = value->lazy;
+			packed.list_sep = value->list_sep;
+
+			if (value->lazy || value->kind == OPT_VALUE_STRING) {
+				packed.raw = pack_string(&pack, value->vstring, strlen(value->vstring));
+			} else if (value->kind == OPT_VALUE_INT || value->kind == OPT_VALUE_FLOAT) {
+				memcpy(&packed.raw, &value->vint, sizeof(packed.raw));
+			} else if (value->kind == OPT_VALUE_BOOL) {
+				packed.raw = value->vbool;
+			} else if (value->kind == OPT_VALUE_INT_LIST || value->kind == OPT_VALUE_FLOAT_LIST) {
+				size_t items_size = value->vlist.len * sizeof(int64_t);
+				packed.len = value->vlist.len;
+				packed.raw = pack_reserve(&pack, items_size);
+				if (pack_fits(&pack, packed.raw, items_size)) memcpy(&pack.buf[packed.raw], value->vlist.items, items_size);
+			} else if (value->kind == OPT_VALUE_STRING_LIST) {
+				size_t slices_size = value->vlist.len * sizeof(Pack_Slice);
+				packed.len = value->vlist.len;
+				packed.raw = pack_reserve(&pack, slices_size);
+				header.slices_len += value->vlist.len;
+
+				for (size_t item = 0; item < value->vlist.len; ++item) {
+					Opt_Slice *slice = &value->vlist.strings[item];
+					Pack_Slice packed_slice = {
+						.offset = pack_string(&pack, slice->ptr, slice->len),
+						.len = slice->len,
+					};
+
+					size_t slice_offset = packed.raw + item * sizeof(Pack_Slice);
+					if (pack_fits(&pack, slice_offset, sizeof(Pack_Slice))) memcpy(&pack.buf[slice_offset], &packed_slice, sizeof(Pack_Slice));
+				}
+			}
+		}
+
+		size_t match_offset = matches_offset + i * sizeof(Pack_Match);
+		if (pack_fits(&pack, match_offset, sizeof(Pack_Match))) memcpy(&pack.buf[match_offset], &packed, sizeof(Pack_Match));
+	}
+
+	header.size = pack.len;
+	if (pack_fits(&pack, header_offset, sizeof(Pack_Header))) memcpy(&pack.buf[header_offset], &header, sizeof(Pack_Header));
+	return pack.len;
+}
+
+// The fence keeps the compiler from reading the buffer again in place of the copy
+static inline void view_copy(void *dest, const uint8_t *src, size_t size) {
+	memcpy(dest, src, size);
+	__atomic_signal_fence(__ATOMIC_SEQ_CST);
+}
+
+static inline bool view_string(const uint8_t *buf, size_t len, uint64_t offset) {
+	return offset < len && memchr(&buf[offset], '\0', len - offset) != NULL;
+}
+
+static inline bool view_array(size_t len, uint64_t offset, uint64_t items_len, size_t item_size) {
+	return offset % sizeof(uint64_t) == 0 && offset <= len && items_len <= (len - offset) / item_size;
+}
+
+bool opt_result_view(Opt_Result *result, Opt_Match *matches, size_t matches_size, Opt_Arena *arena, const void *buf, size_t len) {
+	const uint8_t *base = buf;
+	Pack_Header header;
+
+	// The buffer may come from another process, so nothing in it is trusted
+	if ((uintptr_t)base % sizeof(uint64_t) != 0 || len < sizeof(header)) return false;
+	view_copy(&header, base, sizeof(header));
+
+	if (header.magic != PACK_MAGIC || header.version != PACK_VERSION || header.size > len) return false;
+	len = header.size;
+
+	if (!view_array(len, sizeof(header), header.matches_len, sizeof(Pack_Match)) || header.matches_len > matches_size) return false;
+	if (header.bin_name != 0 && !view_string(base, len, header.bin_name)) return false;
+
+	Opt_Slice *slices = NULL;
+	if (header.slices_len != 0) {
+		if (arena == NULL) return false;
+
+		size_t start = arena_start(arena);
+		if (start > arena->size || header.slices_len > (arena->size - start) / sizeof(Opt_Slice)) return false;
+		slices = (Opt_Slice *)&arena->base[start];
+	}
+
+	size_t slices_len = 0;
+
+	// Every field is copied out once, so that what is checked is what is used
+	for (size_t i = 0; i < header.matches_len; ++i) {
+		Pack_Match packed;
+		view_copy(&packed, &base[sizeof(header) + i * sizeof(Pack_Match)], sizeof(packed));
+
+		if (packed.kind == OPT_MATCH_SIMPLE) {
+			if (!view_string(base, len, packed.raw)) return false;
+			matches[i] = match_simple((const char *)&base[packed.raw]);
+			continue;
+		}
+
+		if (packed.kind == OPT_MATCH_MISSING) {
+			matches[i] = match_missing(packed.opt);
+			continue;
+		}
+
+		if (packed.kind != OPT_MATCH_OPTION || packed.value_kind > OPT_VALUE_STRING_LIST) return false;
+
+		Opt_Value value = {
+			.kind = packed.value_kind,
+			.lazy = packed.lazy,
+			.list_sep = packed.list_sep,
+		};
+
+		if (value.lazy || value.kind == OPT_VALUE_STRING) {
+			if (!view_string(base, len, packed.raw)) return false;
+			value.vstring = (const char *)&base[packed.raw];
+		} else if (value.kind == OPT_VALUE_INT || value.kind == OPT_VALUE_FLOAT) {
+			memcpy(&value.vint, &packed.raw, sizeof(packed.raw));
+		} else if (value.kind == OPT_VALUE_BOOL) {
+			value.vbool = packed.raw;
+		} else if (value.kind == OPT_VALUE_INT_LIST || value.kind == OPT_VALUE_FLOAT_LIST) {
+			// Lists are used in place
+			if (!view_array(len, packed.raw, packed.len, sizeof(int64_t))) return false;
+			value.vlist.items = (void *)&base[packed.raw];
+			value.vlist.len = packed.len;
+			value.vlist.size = packed.len;
+		} else if (value.kind == OPT_VALUE_STRING_LIST) {
+			if (!view_array(len, packed.raw, packed.len, sizeof(Pack_Slice)) || packed.len > header.slices_len - slices_len) return false;
+
+			for (size_t item = 0; item < packed.len; ++item) {
+				Pack_Slice packed_slice;
+				view_copy(&packed_slice, &base[packed.raw + item * sizeof(Pack_Slice)], sizeof(packed_slice));
+				if (packed_slice.offset >= len || packed_slice.len >= len - packed_slice.offset) return false;
+
+				slices[slices_len + item] = (Opt_Slice) {
+					.ptr = (const char *)&base[packed_slice.offset],
+					.len = packed_slice.len,
+				};
+			}
+
+			value.vlist.strings = &slices[slices_len];
+			value.vlist.len = packed.len;
+			value.vlist.size = packed.len;
+			slices_len += packed.len;
+		}
+
+		matches[i] = match_option(packed.opt, value);
+	}
+
+	if (slices_len != 0) arena->len = (char *)&slices[slices_len] - arena->base;
+
+	result->bin_name = header.bin_name != 0 ? (const char *)&base[header.bin_name] : NULL;
+	result->matches = matches;
+	result->matches_len = header.matches_len;
+	result->matches_size = matches_size;
+	result->simple = header.simple;
+	result->option = header.option;
+	result->missing = header.missing;
+	return true;
+}
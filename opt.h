@@ -12,15 +12,35 @@ typedef enum {
 	OPT_VALUE_INT,
 	OPT_VALUE_FLOAT,
 	OPT_VALUE_BOOL,
+	OPT_VALUE_INT_LIST,
+	OPT_VALUE_FLOAT_LIST,
+	OPT_VALUE_STRING_LIST,
 } Opt_Value_Kind;
 
+typedef struct {
+	const char *ptr;
+	size_t len;
+} Opt_Slice;
+
 typedef struct {
 	Opt_Value_Kind kind;
+	char list_sep;
+	bool lazy;
 	union {
 		const char *vstring;
 		int64_t vint;
 		double vfloat;
 		bool vbool;
+		struct {
+			union {
+				void *items;
+				int64_t *ints;
+				double *floats;
+				Opt_Slice *strings;
+			};
+			size_t len;
+			size_t size;
+		} vlist;
 	};
 } Opt_Value;
 
@@ -31,6 +51,7 @@ typedef enum {
 	OPT_ERROR_DUPLICATE_OPTION,
 	OPT_ERROR_MISSING_VALUE,
 	OPT_ERROR_INVALID_VALUE,
+	OPT_ERROR_LIST_OVERFLOW,
 } Opt_Error_Kind;
 
 typedef struct {
@@ -48,7 +69,8 @@ typedef struct {
 		struct {
 			Opt_Value_Kind expected_value;
 			const char *base;
-		} invalid;
+			size_t offset;
+		} invalid; // NOTE: Also used by OPT_ERROR_LIST_OVERFLOW
 	};
 } Opt_Error;
 
@@ -72,13 +94,32 @@ typedef struct {
 	Opt_Value_Kind value_kind;
 	const char *value_name;
 	Opt_Info_Flag flags;
-	size_t _seen;
-	size_t _match;
+	char list_sep;
 } Opt_Info;
 
+typedef struct {
+	char *base;
+	size_t len;
+	size_t size;
+} Opt_Arena;
+
+#define OPT_ID_NONE SIZE_MAX
+
+typedef struct Opt_Table Opt_Table;
+typedef struct Opt_Batch_Block Opt_Batch_Block;
+
 typedef struct {
 	Opt_Info *opts;
 	size_t opts_len;
+	Opt_Arena *arena;
+	bool lazy;
+	Opt_Table *_table;
+	Opt_Table *_retired;
+	Opt_Table *_draining;
+	uint64_t _fingerprint;
+	size_t _epoch;
+	size_t _active[2];
+	bool _lock;
 } Opt_Parser;
 
 typedef struct {
@@ -116,14 +157,52 @@ typedef struct {
 	size_t missing;
 } Opt_Result;
 
+typedef struct {
+	const char **args;
+	size_t args_len;
+	size_t records_len;
+	size_t *records_arg;
+	size_t *records_argc;
+	Opt_Error *errors;
+	Opt_Match **records_matches;
+	size_t *matches_count;
+	Opt_Batch_Block *_blocks;
+} Opt_Batch;
+
+typedef struct {
+	uint64_t hits;
+	uint64_t misses;
+	uint64_t stores;
+	uint64_t oversized;
+} Opt_Cache_Stats;
+
+typedef struct {
+	void *map;
+	size_t map_size;
+	size_t slots_len;
+	Opt_Cache_Stats stats;
+} Opt_Cache;
+
 typedef void (*Opt_Result_Simple_F)(const char *simple);
 
 typedef void (*Opt_Result_Option_F)(Opt_Value value, bool missing);
 
+// List values are stored in value->vlist.items, up to value->vlist.size elements, or only counted if items is NULL
 Opt_Error opt_value_read(Opt_Value *value, const char *base);
 
+// Converts a value left as raw token by a lazy parser, in place
+Opt_Error opt_value_get(Opt_Value *value);
+
+Opt_Error opt_value_int(Opt_Value *value, int64_t *vint);
+
+Opt_Error opt_value_float(Opt_Value *value, double *vfloat);
+
+Opt_Error opt_value_bool(Opt_Value *value, bool *vbool);
+
 void opt_value_print(Opt_Value value, FILE *file);
 
+void opt_arena_init(Opt_Arena *arena, void *base, size_t size);
+
 void opt_info_init(Opt_Info *info, const char *long_name, const char *short_name, const char *desc, Opt_Value_Kind value_kind, const char *value_name, Opt_Info_Flag flags);
 
 void opt_info_usage(Opt_Info *opts, size_t opts_len, Opt_Usage *usage, FILE *file);
@@ -136,8 +215,54 @@ void opt_result_sort(Opt_Result *result, bool sort_opt);
 
 void opt_result_iter(Opt_Result *result, Opt_Result_Simple_F simple_f, Opt_Result_Option_F *opt_fs);
 
+Opt_Error opt_result_validate(Opt_Result *result);
+
+// Returns the size needed, which is only all written if it fits in size
+size_t opt_result_pack(Opt_Result *result, void *buf, size_t size);
+
+// Values and strings stay in the packed buffer, which must not change while the result is used
+// Only the matches and string list slices are laid out
+bool opt_result_view(Opt_Result *result, Opt_Match *matches, size_t matches_size, Opt_Arena *arena, const void *buf, size_t len);
+
 void opt_parser_init(Opt_Parser *parser, Opt_Info *opts, size_t opts_len);
 
 Opt_Error opt_parser_run(Opt_Parser *parser, Opt_Result *result, const char **argv, const int argc);
 
+// Option ids are positions in opts until the first add or remove, then they never change
+size_t opt_parser_add(Opt_Parser *parser, const Opt_Info *info);
+
+bool opt_parser_remove(Opt_Parser *parser, size_t id);
+
+size_t opt_parser_list(Opt_Parser *parser, Opt_Info *opts, size_t *ids, size_t opts_size);
+
+// Frees the tables replaced while runs were going, once the runs that started before are done
+// Runs started later do not hold it back, once it returns true names of removed options can be freed
+bool opt_parser_reclaim(Opt_Parser *parser);
+
+void opt_parser_free(Opt_Parser *parser);
+
+// Records are laid out back to back in buf, each one records_size[record] bytes of NUL-terminated arguments
+bool opt_batch_init(Opt_Batch *batch, const char *buf, const size_t *records_size, size_t records_len);
+
+bool opt_batch_run(Opt_Batch *batch, Opt_Parser *parser, size_t threads);
+
+void opt_batch_result(Opt_Batch *batch, size_t record, Opt_Result *result);
+
+void opt_batch_free(Opt_Batch *batch);
+
+// A hit hashes every argument and copies and checks a slot, which costs more than parsing a usual command line
+// The cache only pays off when parsing is expensive, otherwise opt_parser_run is faster
+// slots_len only sizes a new file, an existing one keeps its own
+bool opt_cache_open(Opt_Cache *cache, const char *path, size_t slots_len);
+
+void opt_cache_close(Opt_Cache *cache);
+
+// Falls back to opt_parser_run on miss, only successful and stopped runs are stored
+// An entry takes one 4 KiB slot, so results over about 120 matches or with long lists are never stored and counted as oversized
+// The opts of a parser without added or removed options must not change after its first cached run
+Opt_Error opt_cache_run(Opt_Cache *cache, Opt_Parser *parser, Opt_Result *result, const char **argv, const int argc);
+
+// Totals of every process sharing the cache file, cache->stats only counts this one
+void opt_cache_stats(Opt_Cache *cache, Opt_Cache_Stats *stats);
+
 #endif
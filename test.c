@@ -13,12 +13,15 @@ static void print_option(size_t opt, Opt_Info *opts) {
 }
 
 static void print_error(Opt_Error error, Opt_Info *opts) {
-	const char *value[5] = {
+	const char *value[8] = {
 		"",
 		"string",
 		"int",
-		"float"
+		"float",
 		"bool",
+		"int list",
+		"float list",
+		"string list",
 	};
 
 	switch (error.kind) {
@@ -50,7 +53,11 @@ static void print_error(Opt_Error error, Opt_Info *opts) {
 			break;
 
 		case OPT_ERROR_INVALID_VALUE:
-			printf("error: invalid value, expected %s, got '%s'\n", value[error.invalid.expected_value], error.invalid.base);
+			printf("error: invalid value, expected %s, got '%s' at %zu\n", value[error.invalid.expected_value], error.invalid.base, error.invalid.offset);
+			break;
+
+		case OPT_ERROR_LIST_OVERFLOW:
+			printf("error: too many elements, expected %s, got '%s' at %zu\n", value[error.invalid.expected_value], error.invalid.base, error.invalid.offset);
 			break;
 
 		default:
@@ -79,17 +86,25 @@ int main(int argc, const char **argv) {
 	Opt_Match matches[10];
 	opt_result_init(&result, matches, LEN(matches));
 
-	Opt_Info opts[5];
+	Opt_Info opts[6];
 	opt_info_init(&opts[0], "help", "h", "Show help information", OPT_VALUE_NONE, NULL, OPT_INFO_STOP_PARSER);
 	opt_info_init(&opts[1], "verbose", "v", "Set verbose output", OPT_VALUE_NONE, NULL, OPT_INFO_MATCH_FIRST);
 	opt_info_init(&opts[2], "", "o", "Set output file path", OPT_VALUE_STRING, "FILE", OPT_INFO_MATCH_MISSING);
 	opt_info_init(&opts[3], "must-write", NULL, "Set must-write flag", OPT_VALUE_BOOL, NULL, OPT_INFO_MATCH_LAST);
 	opt_info_init(&opts[4], "number", NULL, "Set number", OPT_VALUE_INT, NULL, OPT_INFO_STOP_DUPLICATE);
+	opt_info_init(&opts[5], "ids", NULL, "Set ids and ranges of ids", OPT_VALUE_INT_LIST, NULL, OPT_INFO_NONE);
+
+	int64_t items[64];
+	Opt_Arena arena;
+	opt_arena_init(&arena, items, sizeof(items));
 
 	Opt_Parser parser;
 	opt_parser_init(&parser, opts, LEN(opts));
+	parser.arena = &arena;
+	parser.lazy = true;
 
 	Opt_Error error = opt_parser_run(&parser, &result, argv, argc);
+	if (error.kind == OPT_ERROR_NONE) error = opt_result_validate(&result);
 	if (error.kind != OPT_ERROR_NONE) {
 		print_error(error, opts);
 		exit(1);